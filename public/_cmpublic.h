@@ -30,6 +30,8 @@
 #include <semaphore.h>
 #include <sys/stat.h>
 #include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/ipc.h>
@@ -37,9 +39,15 @@
 #include <sys/shm.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <sys/timerfd.h>
 #include <sys/signalfd.h>
+#include <sys/sendfile.h>
+#include <sys/wait.h>
+#include <sys/inotify.h>
+#include <endian.h>
+#include <zlib.h>
 
 // C++
 #include <atomic>
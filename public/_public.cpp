@@ -212,51 +212,84 @@ string picknumber(const string &src,const bool bsigned,const bool bdot)
 
 bool matchstr(const string &str,const string &rules)
 {
-    // 如果匹配规则表达式的内容是空的，返回false。
-    if (rules.length() == 0) return false;
-
-    // 如果如果匹配规则表达式的内容是"*"，直接返回true。
-    if (rules == "*") return true;
-
-    int  ii,jj;
-    int  pos1,pos2;
-    ccmdstr cmdstr,cmdsubstr;
+    return cmatchstr(rules).match(str);
+}
 
-    string filename=str;
-    string matchstr=rules;
+void cmatchstr::compile(const string &rules)
+{
+    m_rules.clear();
 
-    // 把字符串都转换成大写后再来比较
-    toupper(filename);
-    toupper(matchstr);
+    string strrules=rules;
+    toupper(strrules);     // 把规则转换成大写，匹配时只需要转换被匹配的字符。
 
-    cmdstr.splittocmd(matchstr,",");
+    ccmdstr cmdstr,cmdsubstr;
+    cmdstr.splittocmd(strrules,",");
 
-    for (ii=0;ii<cmdstr.size();ii++)
+    for (int ii=0;ii<cmdstr.size();ii++)
     {
         // 如果为空，就一定要跳过，否则就会被匹配上。
         if (cmdstr[ii].empty() == true) continue;
 
-        pos1=pos2=0;
+        // "*.XML"被拆分成""和".XML"两段，首段和末段可能是空的。
         cmdsubstr.splittocmd(cmdstr[ii],"*");
 
-        for (jj=0;jj<cmdsubstr.size();jj++)
+        vector<string> parts;
+        for (int jj=0;jj<cmdsubstr.size();jj++) parts.push_back(cmdsubstr[jj]);
+
+        m_rules.push_back(std::move(parts));
+    }
+}
+
+// 比较str开头的part.length()个字符与大写的part是否相同，忽略str中字母的大小写。
+static bool upperequal(const char *str,const string &part)
+{
+    for (size_t ii=0;ii<part.length();ii++)
+    {
+        char cc=str[ii];
+        if ( (cc >= 'a') && (cc <= 'z') ) cc=cc - 32;
+        if (cc != part[ii]) return false;
+    }
+
+    return true;
+}
+
+bool cmatchstr::match(const char *str,const size_t len) const
+{
+    for (auto &parts:m_rules)
+    {
+        const string &first=parts.front();
+        const string &last=parts.back();
+
+        // 没有星号，必须完全相同。
+        if (parts.size() == 1)
         {
-            // 如果是文件名的首部
-            if (jj == 0)
-                if (filename.substr(0,cmdsubstr[jj].length())!=cmdsubstr[jj]) break;
+            if ( (len == first.length()) && (upperequal(str,first) == true) ) return true;
+            continue;
+        }
+
+        // 首段和末段不能重叠。
+        if (len < first.length()+last.length()) continue;
 
-            // 如果是文件名的尾部
-            if (jj == cmdsubstr.size()-1)
-                if (filename.find(cmdsubstr[jj],filename.length()-cmdsubstr[jj].length()) == string::npos) break;
+        // 文件名的首部和尾部。
+        if (upperequal(str,first) == false) continue;
+        if (upperequal(str+len-last.length(),last) == false) continue;
 
-            pos2=filename.find(cmdsubstr[jj],pos1);
+        // 中间各段依次出现在首部和尾部之间。
+        size_t pos=first.length();
+        size_t end=len-last.length();
+        size_t jj;
+        for (jj=1;jj<parts.size()-1;jj++)
+        {
+            const string &part=parts[jj];
+
+            while ( (pos+part.length() <= end) && (upperequal(str+pos,part) == false) ) pos++;
 
-            if (pos2 == string::npos) break;
+            if (pos+part.length() > end) break;
 
-            pos1=pos2+cmdsubstr[jj].length();
+            pos=pos+part.length();
         }
 
-        if (jj==cmdsubstr.size()) return true;
+        if (jj == parts.size()-1) return true;
     }
 
     return false;
@@ -480,6 +513,87 @@ bool getxmlbuffer(const string &xmlbuffer,const string &fieldname,string  &value
     return true;
 }
 
+size_t cxmlrecord::parse(const char *buffer,const size_t len)
+{
+    m_fields.clear();
+    m_hint=0;
+
+    const char *pos=buffer;
+    const char *end=buffer+len;
+
+    while (pos<end)
+    {
+        // 查找开始标签。
+        const char *start=(const char *)memchr(pos,'<',end-pos);
+        if (start==nullptr) break;
+
+        const char *gt=(const char *)memchr(start+1,'>',end-start-1);
+        if (gt==nullptr) break;
+
+        pos=gt+1;
+
+        // 结束标签和<endl/>这样的自闭合标签不是字段。
+        if ( (start[1]=='/') || (gt[-1]=='/') || (gt==start+1) ) continue;
+
+        st_field field;
+        field.name=start+1;
+        field.namelen=gt-start-1;
+        field.value=pos;
+
+        // 查找与开始标签对应的结束标签，字段的内容中可能有'<'，不匹配的跳过。
+        const char *close=pos;
+        while (true)
+        {
+            close=(const char *)memchr(close,'<',end-close);
+            if (close==nullptr) break;
+
+            if ( ((size_t)(end-close)>=field.namelen+3) && (close[1]=='/') &&
+                 (memcmp(close+2,field.name,field.namelen)==0) && (close[field.namelen+2]=='>') ) break;
+
+            close++;
+        }
+        // 没有结束标签，例如文件开头的<data>与第一条记录读在了一起，跳过这个标签。
+        if (close==nullptr) continue;
+
+        field.valuelen=close-pos;
+        m_fields.push_back(field);
+
+        pos=close+field.namelen+3;
+    }
+
+    return m_fields.size();
+}
+
+const cxmlrecord::st_field *cxmlrecord::find(const char *name,const size_t namelen)
+{
+    // 从上一次找到的字段之后开始查找，字段按顺序提取时只需比较一次。
+    for (size_t ii=0;ii<m_fields.size();ii++)
+    {
+        size_t jj=(m_hint+ii)%m_fields.size();
+
+        if ( (m_fields[jj].namelen==namelen) && (memcmp(m_fields[jj].name,name,namelen)==0) )
+        {
+            m_hint=jj+1;
+            return &m_fields[jj];
+        }
+    }
+
+    return nullptr;
+}
+
+bool cxmlrecord::getvalue(const string &name,string &value,const int ilen)
+{
+    const st_field *field=find(name);
+    if (field==nullptr) return false;
+
+    size_t len=field->valuelen;
+    if ( (ilen>0) && ((size_t)ilen<len) ) len=ilen;
+
+    value.assign(field->value,len);
+
+    return true;
+}
+
 bool getxmlbuffer(const string &xmlbuffer,const string &fieldname,char *value,const int len)
 {
     if (value==nullptr) return false;
@@ -863,6 +977,254 @@ void cifile::close()
     fin.close(); 
 }
 
+bool cmmapfile::open(const string &filename)
+{
+    close();
+
+    m_filename=filename;
+
+    if ( (m_fd=::open(m_filename.c_str(),O_RDONLY|O_CLOEXEC)) < 0 ) return false;
+
+    struct stat st_filestat;
+    if (fstat(m_fd,&st_filestat) != 0) { close(); return false; }
+
+    m_size=st_filestat.st_size;
+    m_pos=0;
+
+    if (m_size == 0) return true;      // 长度为0的文件不能映射。
+
+    void *data=mmap(nullptr,m_size,PROT_READ,MAP_PRIVATE,m_fd,0);
+    if (data == MAP_FAILED) { close(); return false; }
+
+    m_data=static_cast<char *>(data);
+
+    // 从头到尾顺序读取，让内核加大预读。
+    madvise(m_data,m_size,MADV_SEQUENTIAL);
+
+    return true;
+}
+
+bool cmmapfile::readrecord(const char *&record,size_t &len,const string &endbz)
+{
+    if ( (m_data == nullptr) || (m_pos >= m_size) || (endbz.empty() == true) ) return false;
+
+    const char *start=m_data+m_pos;
+    const char *end=(const char *)memmem(start,m_size-m_pos,endbz.c_str(),endbz.length());
+    if (end == nullptr) { m_pos=m_size; return false; }
+
+    record=start;
+    len=end-start+endbz.length();
+
+    // 跳过结尾标志后面的换行符。
+    m_pos=m_pos+len;
+    if ( (m_pos < m_size) && (m_data[m_pos] == '\n') ) m_pos++;
+
+    return true;
+}
+
+void cmmapfile::close()
+{
+    if (m_data != nullptr) { munmap(m_data,m_size); m_data=nullptr; }
+
+    if (m_fd >= 0) { ::close(m_fd); m_fd=-1; }
+
+    m_size=m_pos=0;
+}
+
+// 二进制格式数据文件中的整数采用小端字节序，与主机的字节序无关。
+static void putle(string &buffer,const unsigned int value,const int bytes)
+{
+    for (int ii=0;ii<bytes;ii++) buffer.append(1,static_cast<char>((value>>(ii*8))&0xff));
+}
+
+static unsigned int getle(const char *buffer,const int bytes)
+{
+    unsigned int value=0;
+    for (int ii=0;ii<bytes;ii++) value|=static_cast<unsigned int>(static_cast<unsigned char>(buffer[ii]))<<(ii*8);
+    return value;
+}
+
+bool cbinwriter::start(cofile &ofile,const vector<string> &names,const vector<int> &lens,
+                       const bool bcompress,const size_t bufsize)
+{
+    bool ret=true;
+
+    if (m_ofile!=nullptr) ret=flush();
+
+    m_ofile=&ofile;
+    m_buffer.clear();
+    m_rows=0;
+    m_bcompress=bcompress;
+
+    m_bufsize=bufsize;
+    m_buffer.reserve(m_bufsize+m_bufsize/4);
+
+    // 文件头。
+    string header("IDCB",4);
+    header.append(1,1);
+    header.append(1,static_cast<char>(m_bcompress?BINFILE_COMPRESS:0));
+    putle(header,names.size(),2);
+    for (size_t ii=0;ii<names.size();ii++)
+    {
+        size_t len=min(names[ii].length(),static_cast<size_t>(255));
+        header.append(1,static_cast<char>(len)).append(names[ii],0,len);
+        putle(header,(ii<lens.size())?lens[ii]:0,2);
+    }
+
+    if (m_ofile->write(&header[0],header.length())==false) ret=false;
+
+    return ret;
+}
+
+bool cbinwriter::flush()
+{
+    if (m_rows==0) return true;
+
+    if (m_ofile==nullptr) return false;
+
+    // 压缩后没有变小的数据块不压缩。
+    const char *data=m_buffer.data();
+    size_t len=m_buffer.length();
+    if (m_bcompress==true)
+    {
+        uLongf zlen=compressBound(m_buffer.length());
+        m_zbuffer.resize(zlen);
+        if ( (compress2(reinterpret_cast<Bytef *>(&m_zbuffer[0]),&zlen,
+                        reinterpret_cast<const Bytef *>(m_buffer.data()),m_buffer.length(),1)==Z_OK) &&
+             (zlen<m_buffer.length()) )
+        {
+            data=m_zbuffer.data(); len=zlen;
+        }
+    }
+
+    string header;
+    putle(header,m_rows,4);
+    putle(header,m_buffer.length(),4);
+    putle(header,len,4);
+
+    bool ret=(m_ofile->write(&header[0],header.length())==true) &&
+             (m_ofile->write(const_cast<char *>(data),len)==true);
+
+    m_buffer.clear();     // clear()不会释放内存，缓冲区可以重用。
+    m_rows=0;
+
+    return ret;
+}
+
+bool cbinreader::open(const string &filename)
+{
+    close();
+
+    if (m_file.open(filename)==false) return false;
+
+    const char *data=m_file.data();
+    size_t size=m_file.size();
+
+    // 文件头的固定部分是8字节。
+    if ( (size<8) || (memcmp(data,"IDCB",4)!=0) || (data[4]!=1) ) { close(); return false; }
+
+    size_t count=getle(data+6,2);
+    size_t pos=8;
+    for (size_t ii=0;ii<count;ii++)
+    {
+        if (pos+1>size) { close(); return false; }
+        size_t len=static_cast<unsigned char>(data[pos]);
+        if (pos+1+len+2>size) { close(); return false; }
+
+        m_names.emplace_back(data+pos+1,len);
+        m_lens.push_back(getle(data+pos+1+len,2));
+        pos=pos+1+len+2;
+    }
+
+    m_pos=pos;
+    m_values.resize(count);
+    m_bgood=true;
+
+    return true;
+}
+
+bool cbinreader::readblock()
+{
+    const char *data=m_file.data();
+    size_t size=m_file.size();
+
+    if (m_pos==size) return false;     // 文件已读完。
+
+    // 数据块头是12字节。
+    if (size-m_pos<12) { m_bgood=false; return false; }
+
+    unsigned int rows=getle(data+m_pos,4);
+    size_t rawlen=getle(data+m_pos+4,4);
+    size_t storedlen=getle(data+m_pos+8,4);
+    if (size-m_pos-12<storedlen) { m_bgood=false; return false; }
+
+    const char *block=data+m_pos+12;
+    if (storedlen==rawlen)
+    {   // 没有压缩的数据块，直接从映射区读取。
+        m_ptr=block;
+    }
+    else
+    {
+        m_block.resize(rawlen);
+        uLongf len=rawlen;
+        if ( (uncompress(reinterpret_cast<Bytef *>(&m_block[0]),&len,
+                         reinterpret_cast<const Bytef *>(block),storedlen)!=Z_OK) || (len!=rawlen) )
+        {
+            m_bgood=false; return false;
+        }
+        m_ptr=m_block.data();
+    }
+
+    m_end=m_ptr+rawlen;
+    m_rows=rows;
+    m_pos=m_pos+12+storedlen;
+
+    return true;
+}
+
+bool cbinreader::next()
+{
+    if (m_bgood==false) return false;
+
+    while (m_rows==0)
+        if (readblock()==false) return false;
+
+    for (size_t ii=0;ii<m_values.size();ii++)
+    {
+        if (m_end-m_ptr<2) { m_bgood=false; return false; }
+        size_t len=getle(m_ptr,2);
+        if (static_cast<size_t>(m_end-m_ptr-2)<len) { m_bgood=false; return false; }
+
+        m_values[ii].first=m_ptr+2;
+        m_values[ii].second=len;
+        m_ptr=m_ptr+2+len;
+    }
+
+    m_rows--;
+
+    return true;
+}
+
+int cbinreader::findfield(const char *name) const
+{
+    for (size_t ii=0;ii<m_names.size();ii++)
+        if (m_names[ii]==name) return ii;
+
+    return -1;
+}
+
+void cbinreader::close()
+{
+    m_file.close();
+    m_names.clear();
+    m_lens.clear();
+    m_values.clear();
+    m_pos=0;
+    m_ptr=m_end=nullptr;
+    m_rows=0;
+    m_bgood=false;
+}
+
 bool cifile::readline(string &buf,const string& endbz)
 {
     buf.clear();            // 清空buf。
@@ -953,6 +1315,35 @@ void cofile::close()
         remove(m_filenametmp.c_str());
 }
 
+bool cxmlwriter::attach(cofile &ofile,const size_t bufsize)
+{
+    bool ret=true;
+
+    if (m_ofile!=nullptr) ret=flush();
+
+    m_ofile=&ofile;
+    m_buffer.clear();
+
+    // 多预留一些空间，追加最后一条记录时不必扩大缓冲区。
+    m_bufsize=bufsize;
+    m_buffer.reserve(m_bufsize+m_bufsize/4);
+
+    return ret;
+}
+
+bool cxmlwriter::flush()
+{
+    if (m_buffer.empty()==true) return true;
+
+    if (m_ofile==nullptr) return false;
+
+    bool ret=m_ofile->write(&m_buffer[0],m_buffer.length());
+
+    m_buffer.clear();     // clear()不会释放内存，缓冲区可以重用。
+
+    return ret;
+}
+
 bool newdir(const string &pathorfilename,bool bisfilename)
 {
     // /tmp/aaa/bbb/ccc/ddd    /tmp    /tmp/aaa    /tmp/aaa/bbb    /tmp/aaa/bbb/ccc 
@@ -987,7 +1378,7 @@ bool newdir(const string &pathorfilename,bool bisfilename)
     return true;
 }
 
-int filesize(const string &filename)
+long filesize(const string &filename)
 {
     struct stat st_filestat;      // 存放文件信息的结构体。
 
@@ -1109,8 +1500,10 @@ void cdir::setfmt(const string &fmt)
     m_fmt=fmt;
 }
 
-bool cdir::opendir(const string &dirname,const string &rules,const int maxfiles,const bool bandchild,bool bsort)
+bool cdir::opendir(const string &dirname,const string &rules,const int maxfiles,const bool bandchild,bool bsort,const int threads)
 {
+    closestream();           // 关闭流方式下打开的目录。
+
     m_filelist.clear();    // 清空文件列表容器。
     m_pos=0;              // 从文件列表中已读取文件的位置归0。
 
@@ -1118,7 +1511,14 @@ bool cdir::opendir(const string &dirname,const string &rules,const int maxfiles,
     if (newdir(dirname,false) == false) return false;
 
     // 打开目录，获取目录中的文件列表，存放在m_filelist容器中。
-    bool ret=_opendir(dirname,rules,maxfiles,bandchild);
+    // 匹配规则只编译一次。
+    cmatchstr matcher(rules);
+
+    bool ret;
+    if ( (bandchild == true) && (threads > 1) )
+        ret=_opendirparallel(dirname,matcher,maxfiles,threads);
+    else
+        ret=_opendir(dirname,matcher,maxfiles,bandchild);
 
     if (bsort==true)    // 对文件列表排序。
     {
@@ -1129,7 +1529,7 @@ bool cdir::opendir(const string &dirname,const string &rules,const int maxfiles,
 }
 
 // 这是一个递归函数，在opendir()中调用，cdir类的外部不需要调用它。
-bool cdir::_opendir(const string &dirname,const string &rules,const int maxfiles,const bool bandchild)
+bool cdir::_opendir(const string &dirname,const cmatchstr &rules,const int maxfiles,const bool bandchild)
 {
     DIR *dir;   // 目录指针。
 
@@ -1167,7 +1567,7 @@ bool cdir::_opendir(const string &dirname,const string &rules,const int maxfiles
         if (stdir->d_type==8)
         {
             // 把能匹配上的文件放入m_filelist容器中。
-            if (matchstr(stdir->d_name,rules) == false) continue;
+            if (rules.match(stdir->d_name) == false) continue;
 
             m_filelist.push_back(std::move(strffilename));
         }
@@ -1178,8 +1578,106 @@ bool cdir::_opendir(const string &dirname,const string &rules,const int maxfiles
     return true;
 }
 
+bool cdir::_opendirparallel(const string &dirname,const cmatchstr &rules,const int maxfiles,const int threads)
+{
+    // 待扫描的目录放在共享的队列中，线程每次取出一个目录，读取它的内容，发现的子目录再放回队列。
+    // 一个目录的读取时间远远大于队列的操作时间，所以用一个互斥锁保护队列就够了。
+    deque<string> dirs;               // 待扫描的目录。
+    int busy=0;                       // 正在扫描目录的线程数。
+    bool ret=true;                    // 有目录打开失败时设置为false，与_opendir()一致。
+    mutex mtx;                        // 保护dirs、busy、ret和m_filelist的互斥锁。
+    condition_variable cond;          // 队列中有新目录或者全部目录已扫描完时通知等待的线程。
+    atomic<int> count(0);             // 已找到的文件数。
+
+    // 先打开根目录，失败时直接返回，不启动线程。
+    DIR *root;
+    if ( (root=::opendir(dirname.c_str())) == nullptr ) return false;
+    closedir(root);
+
+    dirs.push_back(dirname);
+
+    auto worker=[&]()
+    {
+        vector<string> files;         // 本线程找到的文件，最后再合并到m_filelist中。
+        vector<string> subdirs;       // 本线程在当前目录中发现的子目录。
+        string strdirname;
+        string strffilename;
+
+        while (true)
+        {
+            {
+                unique_lock<mutex> lock(mtx);
+
+                // 队列为空并且还有线程在扫描目录，它可能会发现新的子目录，需要等待。
+                cond.wait(lock,[&]{ return (dirs.empty() == false) || (busy == 0) || (count >= maxfiles); });
+
+                if ( (dirs.empty() == true) || (count >= maxfiles) ) break;
+
+                strdirname=std::move(dirs.front()); dirs.pop_front();
+                busy++;
+            }
+
+            subdirs.clear();
+
+            DIR *dir;
+            if ( (dir=::opendir(strdirname.c_str())) == nullptr )
+            {
+                lock_guard<mutex> lock(mtx); ret=false;
+            }
+            else
+            {
+                struct dirent *stdir;
+
+                while ( ((stdir=::readdir(dir)) != 0) && (count < maxfiles) )
+                {
+                    if (stdir->d_name[0]=='.') continue;
+
+                    strffilename=strdirname+'/'+stdir->d_name;
+
+                    if (stdir->d_type==4) { subdirs.push_back(std::move(strffilename)); continue; }
+
+                    if (stdir->d_type==8)
+                    {
+                        if (rules.match(stdir->d_name) == false) continue;
+
+                        // 先占一个名额，超出maxfiles的文件不要。
+                        if (count++ >= maxfiles) break;
+
+                        files.push_back(std::move(strffilename));
+                    }
+                }
+
+                closedir(dir);
+            }
+
+            {
+                lock_guard<mutex> lock(mtx);
+                for (auto &dd:subdirs) dirs.push_back(std::move(dd));
+                busy--;
+            }
+            cond.notify_all();
+        }
+
+        cond.notify_all();
+
+        // 合并本线程找到的文件。
+        lock_guard<mutex> lock(mtx);
+        m_filelist.insert(m_filelist.end(),make_move_iterator(files.begin()),make_move_iterator(files.end()));
+    };
+
+    vector<thread> vthreads;
+    for (int ii=0;ii<threads;ii++)
+        vthreads.emplace_back(worker);
+
+    for (auto &th:vthreads) th.join();
+
+    return ret;
+}
+
 bool cdir::readdir()
 {
+    if (m_bstream == true) return readdirstream();
+
     // 如果已读完，清空容器
     if (m_pos >= m_filelist.size()) 
     {
@@ -1201,43 +1699,300 @@ bool cdir::readdir()
     m_mtime=timetostr1(st_filestat.st_mtime,m_fmt);   // 文件最后一次被修改的时间。
     m_ctime=timetostr1(st_filestat.st_ctime,m_fmt);      // 文件生成的时间。
     m_atime=timetostr1(st_filestat.st_atime,m_fmt);      // 文件最后一次被访问的时间。
+    m_imtime=st_filestat.st_mtime;
+    m_ictime=st_filestat.st_ctime;
+    m_iatime=st_filestat.st_atime;
 
     m_pos++;       // 已读取文件的位置后移。
 
     return true;
 }
 
-cdir::~cdir()
+// getdents64()返回的目录项，glibc没有提供它的定义。
+struct linux_dirent64
 {
-    m_filelist.clear();
-}
+    ino64_t        d_ino;
+    off64_t        d_off;
+    unsigned short d_reclen;
+    unsigned char  d_type;
+    char           d_name[];
+};
 
-bool renamefile(const string &srcfilename,const string &dstfilename)
+bool cdir::opendirstream(const string &dirname,const string &rules,const bool bandchild)
 {
-    // 如果原文件不存在，直接返回失败。
-    if (access(srcfilename.c_str(),R_OK) != 0) return false;
+    closestream();
 
-    // 创建目标文件的目录。
-    if (newdir(dstfilename,true) == false) return false;
+    m_filelist.clear();
+    m_pos=0;
 
-    // 调用操作系统的库函数rename重命名文件。 mv
-    if (rename(srcfilename.c_str(),dstfilename.c_str()) == 0) return true;
+    // 如果目录不存在，创建它。
+    if (newdir(dirname,false) == false) return false;
 
-    return false;
+    st_dirstream ds;
+    if ( (ds.fd=open(dirname.c_str(),O_RDONLY|O_DIRECTORY|O_CLOEXEC)) < 0 ) return false;
+    ds.dirname=dirname;
+    ds.buffer.resize(32768);
+    ds.pos=ds.len=0;
+
+    m_streams.push_back(std::move(ds));
+    m_rules.compile(rules);
+    m_andchild=bandchild;
+    m_bstream=true;
+
+    return true;
 }
 
-// 忽略关闭全部的信号、关闭全部的IO，缺省只忽略信号，不关IO。 
-// 不希望后台服务程序被信号打扰，需要什么信号可以在程序中设置。
-// 实际上关闭的IO是0、1、2。
-void closeioandsignal(bool bcloseio)
+bool cdir::readdirstream()
 {
-    int ii=0;
+    struct stat st_filestat;
 
-    for (ii=0;ii<64;ii++)
+    while (m_streams.empty() == false)
     {
-        if (bcloseio==true) close(ii);
+        st_dirstream &ds=m_streams.back();
 
-        signal(ii,SIG_IGN); 
+        // 缓冲区中的目录项已处理完，从目录中再读取一批。
+        if (ds.pos >= ds.len)
+        {
+            ds.len=syscall(SYS_getdents64,ds.fd,ds.buffer.data(),ds.buffer.size());
+            ds.pos=0;
+
+            // 目录已读完或读取失败，回到上一级目录。
+            if (ds.len <= 0)
+            {
+                ::close(ds.fd); m_streams.pop_back(); continue;
+            }
+        }
+
+        struct linux_dirent64 *de=(struct linux_dirent64 *)(ds.buffer.data()+ds.pos);
+        ds.pos=ds.pos+de->d_reclen;
+
+        // 文件名以"."打头的文件不处理。
+        if (de->d_name[0]=='.') continue;
+
+        // 有些文件系统不提供文件的类型，只能用fstatat()获取。
+        unsigned char dtype=de->d_type;
+        bool bstat=false;
+        if (dtype==DT_UNKNOWN)
+        {
+            if (fstatat(ds.fd,de->d_name,&st_filestat,0) != 0) continue;
+            bstat=true;
+            if (S_ISDIR(st_filestat.st_mode)) dtype=DT_DIR;
+            if (S_ISREG(st_filestat.st_mode)) dtype=DT_REG;
+        }
+
+        // 如果是目录，打开它，先读完子目录再回到本目录。
+        if (dtype==DT_DIR)
+        {
+            if (m_andchild == false) continue;
+
+            st_dirstream child;
+            if ( (child.fd=openat(ds.fd,de->d_name,O_RDONLY|O_DIRECTORY|O_CLOEXEC)) < 0 ) continue;
+            child.dirname=ds.dirname+'/'+de->d_name;
+            child.buffer.resize(32768);
+            child.pos=child.len=0;
+
+            m_streams.push_back(std::move(child));   // ds已失效，不能再使用。
+            continue;
+        }
+
+        // 只处理能匹配上的普通文件。
+        if (dtype!=DT_REG) continue;
+        if (m_rules.match(de->d_name) == false) continue;
+        if ( (bstat == false) && (fstatat(ds.fd,de->d_name,&st_filestat,0) != 0) ) continue;
+
+        // 用assign()复用字符串已有的内存。
+        m_dirname.assign(ds.dirname);
+        m_filename.assign(de->d_name);
+        m_ffilename.assign(ds.dirname).append(1,'/').append(de->d_name);
+        m_filesize=st_filestat.st_size;
+        m_imtime=st_filestat.st_mtime;
+        m_ictime=st_filestat.st_ctime;
+        m_iatime=st_filestat.st_atime;
+
+        return true;
+    }
+
+    m_bstream=false;
+
+    return false;
+}
+
+void cdir::fmttime()
+{
+    m_mtime=timetostr1(m_imtime,m_fmt);
+    m_ctime=timetostr1(m_ictime,m_fmt);
+    m_atime=timetostr1(m_iatime,m_fmt);
+}
+
+void cdir::closestream()
+{
+    for (auto &ds:m_streams) ::close(ds.fd);
+
+    m_streams.clear();
+    m_bstream=false;
+}
+
+cdir::~cdir()
+{
+    closestream();
+
+    m_filelist.clear();
+}
+
+bool cdirwatch::watch(const string &dirname,const string &rules,const bool bandchild,const int fullscan)
+{
+    close();
+
+    m_rules.compile(rules);
+    m_andchild=bandchild;
+    m_fullscan=fullscan;
+    m_lastscan=time(0);
+
+    if ( (m_fd=inotify_init1(IN_NONBLOCK|IN_CLOEXEC)) < 0 ) { m_fd=-1; return false; }
+
+    // 如果目录不存在，创建它。
+    if ( (newdir(dirname,false) == false) || (addwatch(dirname) == false) ) { close(); return false; }
+
+    return true;
+}
+
+bool cdirwatch::addwatch(const string &dirname)
+{
+    // 监视子目录时，还要知道新建的子目录，以便监视它。
+    uint32_t mask=IN_CLOSE_WRITE|IN_MOVED_TO|IN_ONLYDIR;
+    if (m_andchild==true) mask=mask|IN_CREATE;
+
+    int wd=inotify_add_watch(m_fd,dirname.c_str(),mask);
+    if (wd<0) return false;
+
+    m_wds[wd]=dirname;
+
+    if (m_andchild==false) return true;
+
+    DIR *dir;
+    if ( (dir=::opendir(dirname.c_str())) == nullptr ) return false;
+
+    struct dirent *stdir;
+    while ((stdir=::readdir(dir)) != 0)
+    {
+        if (stdir->d_name[0]=='.') continue;
+
+        if (stdir->d_type==DT_DIR) addwatch(dirname+'/'+stdir->d_name);
+    }
+
+    closedir(dir);
+
+    return true;
+}
+
+bool cdirwatch::wait(const int timeout)
+{
+    // 未能监视目录，只能定时扫描。
+    if (m_fd==-1) { sleep(timeout); return true; }
+
+    time_t deadline=time(0)+timeout;
+    char buffer[65536] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+    while (true)
+    {
+        time_t now=time(0);
+
+        // 距离上一次扫描目录已超过fullscan秒。
+        if (now-m_lastscan>=m_fullscan) { m_lastscan=now; return true; }
+
+        if (now>=deadline) return false;
+
+        struct pollfd fds;
+        fds.fd=m_fd;
+        fds.events=POLLIN;
+
+        int ret=poll(&fds,1,(deadline-now)*1000);
+
+        // 被信号中断，提前返回，调用者可以检查退出标志。
+        if ( (ret<0) && (errno==EINTR) ) return false;
+
+        if (ret<0) { close(); return true; }
+        if (ret==0) continue;
+
+        bool bchanged=false;
+
+        ssize_t len;
+        while ( (len=read(m_fd,buffer,sizeof(buffer))) > 0 )
+        {
+            for (char *ptr=buffer;ptr<buffer+len;ptr=ptr+sizeof(struct inotify_event)+((struct inotify_event *)ptr)->len)
+            {
+                const struct inotify_event *event=(const struct inotify_event *)ptr;
+
+                // 事件队列溢出，有的事件已丢失。
+                if (event->mask & IN_Q_OVERFLOW) { bchanged=true; continue; }
+
+                // 目录已被删除或移走，内核自动取消了监视。
+                if (event->mask & IN_IGNORED) { m_wds.erase(event->wd); continue; }
+
+                if (event->len==0) continue;
+
+                auto it=m_wds.find(event->wd);
+                if (it==m_wds.end()) continue;
+
+                // 新建或移入了子目录，监视它，在添加监视之前写入子目录的文件没有事件，所以要扫描一次。
+                if (event->mask & IN_ISDIR)
+                {
+                    if (m_andchild==true) { addwatch(it->second+'/'+event->name); bchanged=true; }
+                    continue;
+                }
+
+                // 只关心写入完成或移入的文件，新建的文件还没有写完。
+                if ( (event->mask & (IN_CLOSE_WRITE|IN_MOVED_TO)) == 0 ) continue;
+
+                if (event->name[0]=='.') continue;
+
+                if (m_rules.match(event->name)==true) bchanged=true;
+            }
+        }
+
+        if (bchanged==true) { m_lastscan=time(0); return true; }
+    }
+}
+
+void cdirwatch::close()
+{
+    if (m_fd!=-1) ::close(m_fd);
+
+    m_fd=-1;
+    m_wds.clear();
+}
+
+cdirwatch::~cdirwatch()
+{
+    close();
+}
+
+bool renamefile(const string &srcfilename,const string &dstfilename)
+{
+    // 如果原文件不存在，直接返回失败。
+    if (access(srcfilename.c_str(),R_OK) != 0) return false;
+
+    // 创建目标文件的目录。
+    if (newdir(dstfilename,true) == false) return false;
+
+    // 调用操作系统的库函数rename重命名文件。 mv
+    if (rename(srcfilename.c_str(),dstfilename.c_str()) == 0) return true;
+
+    return false;
+}
+
+// 忽略关闭全部的信号、关闭全部的IO，缺省只忽略信号，不关IO。 
+// 不希望后台服务程序被信号打扰，需要什么信号可以在程序中设置。
+// 实际上关闭的IO是0、1、2。
+void closeioandsignal(bool bcloseio)
+{
+    int ii=0;
+
+    for (ii=0;ii<64;ii++)
+    {
+        if (bcloseio==true) close(ii);
+
+        signal(ii,SIG_IGN); 
     }
 }
 
@@ -1275,6 +2030,10 @@ bool ctcpclient::connect(const string &ip,const int port)
         ::close(m_connfd);  m_connfd=-1; return false;
     }
 
+    // 关闭Nagle算法，小报文立即发送，详见ctcpserver::initserver()中的说明。
+    int opt = 1;
+    setsockopt(m_connfd,IPPROTO_TCP,TCP_NODELAY,&opt,sizeof(opt));
+
     return true;
 }
 
@@ -1307,6 +2066,10 @@ bool ctcpserver::initserver(const unsigned int port,const int backlog)
     int opt = 1; 
     setsockopt(m_listenfd,SOL_SOCKET,SO_REUSEADDR,&opt,sizeof(opt));    
 
+    // 关闭Nagle算法，accept()得到的socket会继承这个选项。
+    // 报文头、确认报文都是很小的报文，如果等待对端的ACK再发送，会增加几十毫秒的延时。
+    setsockopt(m_listenfd,IPPROTO_TCP,TCP_NODELAY,&opt,sizeof(opt));
+
     memset(&m_servaddr,0,sizeof(m_servaddr));
     m_servaddr.sin_family = AF_INET;
     m_servaddr.sin_addr.s_addr = htonl(INADDR_ANY);   // 任意ip地址。
@@ -1368,6 +2131,62 @@ bool ctcpclient::read(string &buffer,const int itimeout)  // 接收文本数据
     return(tcpread(m_connfd,buffer,itimeout));
 }
 
+bool ctcpserver::sendfile(const string &filename,const long filesize,const long offset)
+{
+    if (m_connfd==-1) return false;
+
+    return(tcpsendfile(m_connfd,filename,filesize,offset));
+}
+
+bool ctcpclient::sendfile(const string &filename,const long filesize,const long offset)
+{
+    if (m_connfd==-1) return false;
+
+    return(tcpsendfile(m_connfd,filename,filesize,offset));
+}
+
+bool ctcpserver::recvfile(const string &filename,const long filesize,const long offset)
+{
+    if (m_connfd==-1) return false;
+
+    return(tcprecvfile(m_connfd,filename,filesize,offset));
+}
+
+bool ctcpserver::sendfilez(const string &filename,const long filesize,const long offset)
+{
+    if (m_connfd==-1) return false;
+
+    return(tcpsendfilez(m_connfd,filename,filesize,offset));
+}
+
+bool ctcpserver::recvfilez(const string &filename,const long filesize,const long offset)
+{
+    if (m_connfd==-1) return false;
+
+    return(tcprecvfilez(m_connfd,filename,filesize,offset));
+}
+
+bool ctcpclient::recvfile(const string &filename,const long filesize,const long offset)
+{
+    if (m_connfd==-1) return false;
+
+    return(tcprecvfile(m_connfd,filename,filesize,offset));
+}
+
+bool ctcpclient::sendfilez(const string &filename,const long filesize,const long offset)
+{
+    if (m_connfd==-1) return false;
+
+    return(tcpsendfilez(m_connfd,filename,filesize,offset));
+}
+
+bool ctcpclient::recvfilez(const string &filename,const long filesize,const long offset)
+{
+    if (m_connfd==-1) return false;
+
+    return(tcprecvfilez(m_connfd,filename,filesize,offset));
+}
+
 bool ctcpserver::write(const void *buffer,const int ibuflen)  // 发送二进制数据。
 {
     if (m_connfd==-1) return false;
@@ -1548,6 +2367,463 @@ bool writen(const int sockfd,const char *buffer,const size_t n)
     return true;
 }
 
+bool tcpsendfile(const int sockfd,const string &filename,const long filesize,const long offset)
+{
+    if (sockfd==-1) return false;
+
+    int fd=open(filename.c_str(),O_RDONLY);
+    if (fd<0) return false;
+
+    off_t pos=offset;           // 文件中下一次发送的位置。
+    long nleft=filesize-offset;   // 剩余需要发送的字节数。
+    ssize_t nsent;
+
+    // 用sendfile(2)发送，每次最多发送0x7ffff000字节，这是Linux中单次系统调用的上限。
+    while (nleft>0)
+    {
+        nsent=::sendfile(sockfd,fd,&pos,nleft>0x7ffff000?0x7ffff000:nleft);
+
+        if (nsent>0) { nleft=nleft-nsent; continue; }
+
+        if ( (nsent<0) && (errno==EINTR) ) continue;
+
+        // 内核或文件系统不支持sendfile，改为用缓冲区发送剩下的内容。
+        if ( (nsent<0) && ((errno==EINVAL) || (errno==ENOSYS)) ) break;
+
+        // nsent==0表示文件已被截断，其它情况是socket连接已不可用。
+        close(fd); return false;
+    }
+
+    char buffer[65536];         // 读取文件内容的缓冲区。
+    ssize_t nread;
+
+    while (nleft>0)
+    {
+        nread=pread(fd,buffer,nleft>(long)sizeof(buffer)?sizeof(buffer):nleft,pos);
+
+        if ( (nread<0) && (errno==EINTR) ) continue;
+
+        if (nread<=0) { close(fd); return false; }
+
+        if (writen(sockfd,buffer,nread)==false) { close(fd); return false; }
+
+        pos=pos+nread;
+        nleft=nleft-nread;
+    }
+
+    close(fd);
+
+    return true;
+}
+
+bool tcprecvfile(const int sockfd,const string &filename,const long filesize,const long offset)
+{
+    if (sockfd==-1) return false;
+
+    // 文件打不开或写入失败，文件的内容也要从socket中接收完并丢弃，否则socket中残留的数据会被当成下一个报文。
+    int fd=-1;
+    bool bwriteok=false;     // 写入文件是否成功。
+
+    // 创建文件的目录，从头开始接收时清空文件原有的内容，否则保留offset之前的内容。
+    if (newdir(filename,true) == true)
+        fd=open(filename.c_str(),O_WRONLY|O_CREAT|(offset==0?O_TRUNC:0),0644);
+
+    if (fd>=0) bwriteok=true;
+
+    // 预分配磁盘空间，如果文件系统不支持，不必理会。
+    // 采用FALLOC_FL_KEEP_SIZE，文件的大小仍是已接收的字节数，接收失败后可以据此断点续传。
+    if ( (fd>=0) && (filesize>offset) ) fallocate(fd,FALLOC_FL_KEEP_SIZE,offset,filesize-offset);
+
+    loff_t pos=offset;           // 文件中下一次写入的位置。
+    long nleft=filesize-offset;   // 剩余需要接收的字节数。
+
+    // 用splice(2)经过管道把数据从socket移动到文件。
+    int pipefd[2];
+    if ( (bwriteok==true) && (nleft>0) && (pipe(pipefd)==0) )
+    {
+        // 把管道的容量加大到1M，失败了就用缺省的容量。
+        int pipesize=fcntl(pipefd[1],F_SETPIPE_SZ,1048576);
+        if (pipesize<=0) pipesize=65536;
+
+        ssize_t nin,nout;
+
+        while (nleft>0)
+        {
+            nin=splice(sockfd,NULL,pipefd[1],NULL,nleft>pipesize?pipesize:nleft,SPLICE_F_MOVE|SPLICE_F_MORE);
+
+            if ( (nin<0) && (errno==EINTR) ) continue;
+
+            // 内核或文件系统不支持splice，改为用缓冲区接收剩下的内容，此时管道中没有数据。
+            if ( (nin<0) && ((errno==EINVAL) || (errno==ENOSYS)) ) break;
+
+            // nin==0表示对端已关闭连接。
+            if (nin<=0) { close(pipefd[0]); close(pipefd[1]); close(fd); return false; }
+
+            // 把管道中的数据全部写入文件。
+            while (nin>0)
+            {
+                nout=splice(pipefd[0],NULL,fd,&pos,nin,SPLICE_F_MOVE);
+
+                if ( (nout<0) && (errno==EINTR) ) continue;
+
+                if (nout<=0) { bwriteok=false; break; }
+
+                nin=nin-nout;
+                nleft=nleft-nout;
+            }
+
+            if (bwriteok==true) continue;
+
+            // 写入文件失败（如磁盘空间不足），丢弃管道中的数据，剩下的内容用缓冲区接收后丢弃。
+            char discard[65536];
+            while (nin>0)
+            {
+                nout=read(pipefd[0],discard,nin>(long)sizeof(discard)?sizeof(discard):nin);
+
+                if ( (nout<0) && (errno==EINTR) ) continue;
+
+                if (nout<=0) { close(pipefd[0]); close(pipefd[1]); close(fd); return false; }
+
+                nin=nin-nout;
+                nleft=nleft-nout;
+            }
+
+            break;
+        }
+
+        close(pipefd[0]); close(pipefd[1]);
+    }
+
+    // 用缓冲区接收，一次尽可能多地读取数据，减少系统调用的次数。
+    vector<char> buffer(nleft>0?262144:0);
+    ssize_t nread,nwritten;
+
+    while (nleft>0)
+    {
+        nread=recv(sockfd,&buffer[0],nleft>(long)buffer.size()?buffer.size():nleft,0);
+
+        if ( (nread<0) && (errno==EINTR) ) continue;
+
+        // 只有socket连接不可用才提前返回。
+        if (nread<=0) { if (fd>=0) close(fd); return false; }
+
+        for (ssize_t idx=0;(bwriteok==true)&&(idx<nread);idx=idx+nwritten)
+        {
+            nwritten=pwrite(fd,&buffer[idx],nread-idx,pos+idx);
+
+            if ( (nwritten<0) && (errno==EINTR) ) { nwritten=0; continue; }
+
+            if (nwritten<=0) bwriteok=false;
+        }
+
+        pos=pos+nread;
+        nleft=nleft-nread;
+    }
+
+    if ( (fd>=0) && (close(fd)!=0) ) bwriteok=false;
+
+    return bwriteok;
+}
+
+bool tcpsendfilez(const int sockfd,const string &filename,const long filesize,const long offset,const int level)
+{
+    if (sockfd==-1) return false;
+
+    int fd=open(filename.c_str(),O_RDONLY);
+    if (fd<0) return false;
+
+    z_stream zs;
+    memset(&zs,0,sizeof(zs));
+    if (deflateInit(&zs,level) != Z_OK) { close(fd); return false; }
+
+    vector<unsigned char> inbuf(262144);    // 读取文件内容的缓冲区。
+    string outbuf;                          // 压缩后的数据，攒够一块再发送。
+    outbuf.resize(262144);
+
+    off_t pos=offset;            // 文件中下一次读取的位置。
+    long nleft=filesize-offset;   // 剩余需要读取的字节数。
+    bool bok=true;
+
+    while (bok==true)
+    {
+        int flush=Z_NO_FLUSH;
+
+        if (nleft>0)
+        {
+            ssize_t nread=pread(fd,&inbuf[0],nleft>(long)inbuf.size()?inbuf.size():nleft,pos);
+            if ( (nread<0) && (errno==EINTR) ) continue;
+            if (nread<=0) { bok=false; break; }    // 文件已被截断。
+
+            pos=pos+nread;
+            nleft=nleft-nread;
+
+            zs.next_in=&inbuf[0];
+            zs.avail_in=nread;
+        }
+
+        if (nleft==0) flush=Z_FINISH;
+
+        // 压缩本次读取的数据，输出缓冲区满了就发送一块。
+        int ret;
+        do
+        {
+            zs.next_out=(unsigned char *)&outbuf[0];
+            zs.avail_out=outbuf.size();
+
+            ret=deflate(&zs,flush);
+            if (ret==Z_STREAM_ERROR) { bok=false; break; }
+
+            size_t have=outbuf.size()-zs.avail_out;
+            if ( (have>0) && (tcpwrite(sockfd,outbuf.substr(0,have))==false) ) { bok=false; break; }
+        } while (zs.avail_out==0);
+
+        if (ret==Z_STREAM_END) break;
+    }
+
+    deflateEnd(&zs);
+    close(fd);
+
+    if (bok==false) return false;
+
+    // 长度为0的块表示结束。
+    return tcpwrite(sockfd,string());
+}
+
+bool tcprecvfilez(const int sockfd,const string &filename,const long filesize,const long offset)
+{
+    if (sockfd==-1) return false;
+
+    // 文件打不开、写入失败或解压失败，剩下的压缩块也要从socket中接收完并丢弃，与tcprecvfile()相同。
+    int fd=-1;
+    bool bok=false;
+
+    // 创建文件的目录，从头开始接收时清空文件原有的内容，否则保留offset之前的内容。
+    if (newdir(filename,true) == true)
+        fd=open(filename.c_str(),O_WRONLY|O_CREAT|(offset==0?O_TRUNC:0),0644);
+
+    // 预分配磁盘空间，如果文件系统不支持，不必理会。
+    if ( (fd>=0) && (filesize>offset) ) fallocate(fd,FALLOC_FL_KEEP_SIZE,offset,filesize-offset);
+
+    z_stream zs;
+    memset(&zs,0,sizeof(zs));
+    if ( (fd>=0) && (inflateInit(&zs) == Z_OK) ) bok=true;
+
+    string inbuf;                            // 接收到的一块压缩数据。
+    vector<unsigned char> outbuf(262144);    // 解压后的数据。
+    off_t pos=offset;                         // 文件中下一次写入的位置。
+    int ret=Z_OK;
+
+    while (true)
+    {
+        // 只有socket连接不可用才提前返回。
+        if (tcpread(sockfd,inbuf)==false) { bok=false; break; }
+
+        // 长度为0的块表示结束。
+        if (inbuf.empty()==true) break;
+
+        if (bok==false) continue;
+
+        // 对端已发送了压缩流的结尾，不应该还有数据。
+        if (ret==Z_STREAM_END) { bok=false; continue; }
+
+        zs.next_in=(unsigned char *)&inbuf[0];
+        zs.avail_in=inbuf.size();
+
+        do
+        {
+            zs.next_out=&outbuf[0];
+            zs.avail_out=outbuf.size();
+
+            ret=inflate(&zs,Z_NO_FLUSH);
+            if ( (ret!=Z_OK) && (ret!=Z_STREAM_END) && (ret!=Z_BUF_ERROR) ) { bok=false; break; }
+
+            size_t have=outbuf.size()-zs.avail_out;
+            if (pos+(long)have>filesize) { bok=false; break; }    // 解压后的数据比文件大。
+
+            for (size_t idx=0;idx<have;)
+            {
+                ssize_t nwritten=pwrite(fd,&outbuf[idx],have-idx,pos);
+                if ( (nwritten<0) && (errno==EINTR) ) continue;
+                if (nwritten<=0) { bok=false; break; }
+                idx=idx+nwritten;
+                pos=pos+nwritten;
+            }
+        } while ( (bok==true) && (zs.avail_out==0) );
+    }
+
+    inflateEnd(&zs);
+
+    if ( (fd>=0) && (close(fd)!=0) ) bok=false;
+
+    // 压缩流必须完整，并且解压后的大小与文件的大小一致。
+    if ( (bok==false) || (ret!=Z_STREAM_END) || (pos!=filesize) ) return false;
+
+    return true;
+}
+
+bool compressible(const string &filename)
+{
+    static const cmatchstr compressed("*.GZ,*.TGZ,*.ZIP,*.BZ2,*.XZ,*.ZST,*.Z,*.7Z,*.RAR,*.JPG,*.JPEG,*.PNG,*.GIF,*.MP4");
+
+    return compressed.match(filename)==false;
+}
+
+long resumeoffset(const string &filename,const string &mtime,const long filesize)
+{
+    // 临时文件的时间与对端文件的时间不同，说明对端的文件已改变，或者临时文件不是上次接收失败留下的。
+    string strmtime;
+    if (filemtime(filename,strmtime) == false) return 0;
+    if (strmtime != mtime) return 0;
+
+    long size=idc::filesize(filename);
+    if ( (size<=0) || (size>=filesize) ) return 0;
+
+    return size;
+}
+
+// 二进制报文头的长度和标识。
+static const size_t FMSG_HEADLEN=32;
+static const unsigned char FMSG_MAGIC=0xFE;
+
+// 把整数按网络字节序写入缓冲区和从缓冲区中读取，缓冲区不一定是对齐的，所以用memcpy。
+static void putbe32(char *ptr,const uint32_t value) { uint32_t vv=htobe32(value); memcpy(ptr,&vv,4); }
+static void putbe64(char *ptr,const uint64_t value) { uint64_t vv=htobe64(value); memcpy(ptr,&vv,8); }
+static uint32_t getbe32(const char *ptr) { uint32_t vv; memcpy(&vv,ptr,4); return be32toh(vv); }
+static uint64_t getbe64(const char *ptr) { uint64_t vv; memcpy(&vv,ptr,8); return be64toh(vv); }
+
+bool packfilemsg(const st_filemsg &msg,string &buffer,const int protover)
+{
+    if (protover<2)
+    {
+        switch (msg.type)
+        {
+            case FMSG_ACTIVETEST:
+                buffer="<activetest>ok</activetest>"; return true;
+            case FMSG_ACTIVEOK:
+                buffer="ok"; return true;
+            case FMSG_FILEHEAD:
+                sformat(buffer,"<filename>%s</filename><filesize>%ld</filesize><mtime>%s</mtime>%s%s",
+                        msg.filename.c_str(),msg.filesize,msg.mtime.c_str(),
+                        (msg.flags&FMSG_RESUME)?"<resume>true</resume>":"",
+                        (msg.flags&FMSG_COMPRESS)?"<compress>zlib</compress>":"");
+                return true;
+            case FMSG_OFFSET:
+                sformat(buffer,"<filename>%s</filename><offset>%ld</offset>",msg.filename.c_str(),msg.offset);
+                return true;
+            case FMSG_ACK:
+                sformat(buffer,"<filename>%s</filename><result>%s</result>",msg.filename.c_str(),
+                        (msg.flags&FMSG_SUCCESS)?"success":"failed");
+                return true;
+        }
+
+        return false;
+    }
+
+    if ( (msg.type<FMSG_ACTIVETEST) || (msg.type>FMSG_ACK) ) return false;
+
+    // 只有文件信息报文需要文件时间。
+    time_t mtime=0;
+    if (msg.type==FMSG_FILEHEAD)
+    {
+        if ( (mtime=strtotime(msg.mtime)) == -1 ) return false;
+    }
+
+    buffer.resize(FMSG_HEADLEN+msg.filename.size());
+
+    char *ptr=&buffer[0];
+    ptr[0]=FMSG_MAGIC;
+    ptr[1]=msg.type;
+    ptr[2]=msg.flags;
+    ptr[3]=0;
+    putbe32(ptr+4,msg.seq);
+    putbe64(ptr+8,msg.filesize);
+    putbe64(ptr+16,mtime);
+    putbe64(ptr+24,msg.offset);
+    if (msg.filename.empty()==false) memcpy(ptr+FMSG_HEADLEN,msg.filename.data(),msg.filename.size());
+
+    return true;
+}
+
+bool unpackfilemsg(const string &buffer,st_filemsg &msg)
+{
+    msg=st_filemsg();
+
+    if (buffer.empty()==true) return false;
+
+    // 二进制格式。
+    if ((unsigned char)buffer[0]==FMSG_MAGIC)
+    {
+        if (buffer.size()<FMSG_HEADLEN) return false;
+
+        const char *ptr=buffer.data();
+        msg.type=(unsigned char)ptr[1];
+        msg.flags=(unsigned char)ptr[2];
+        msg.seq=getbe32(ptr+4);
+        msg.filesize=getbe64(ptr+8);
+        msg.offset=getbe64(ptr+24);
+        msg.filename.assign(ptr+FMSG_HEADLEN,buffer.size()-FMSG_HEADLEN);
+
+        if ( (msg.type<FMSG_ACTIVETEST) || (msg.type>FMSG_ACK) ) return false;
+
+        if (msg.type==FMSG_FILEHEAD) timetostr(getbe64(ptr+16),msg.mtime,"yyyymmddhh24miss");
+
+        return true;
+    }
+
+    // xml格式。
+    if (buffer=="<activetest>ok</activetest>") { msg.type=FMSG_ACTIVETEST; return true; }
+    if (buffer=="ok") { msg.type=FMSG_ACTIVEOK; return true; }
+
+    if (getxmlbuffer(buffer,"filename",msg.filename)==false) return false;
+
+    if (getxmlbuffer(buffer,"offset",msg.offset)==true) { msg.type=FMSG_OFFSET; return true; }
+
+    string strtemp;
+    if (getxmlbuffer(buffer,"result",strtemp)==true)
+    {
+        msg.type=FMSG_ACK;
+        if (strtemp=="success") msg.flags=FMSG_SUCCESS;
+        return true;
+    }
+
+    msg.type=FMSG_FILEHEAD;
+    getxmlbuffer(buffer,"filesize",msg.filesize);
+    getxmlbuffer(buffer,"mtime",msg.mtime);
+
+    bool bresume=false;
+    getxmlbuffer(buffer,"resume",bresume);
+    if (bresume==true) msg.flags|=FMSG_RESUME;
+
+    if ( (getxmlbuffer(buffer,"compress",strtemp)==true) && (strtemp=="zlib") ) msg.flags|=FMSG_COMPRESS;
+
+    return true;
+}
+
+void csendwindow::push(const unsigned int seq,const string &filename,const long filesize)
+{
+    m_inflight.push_back(st_inflight{seq,filename,filesize});
+    m_bytes=m_bytes+filesize;
+}
+
+bool csendwindow::ack(const st_filemsg &msg,st_inflight &item)
+{
+    // 接收端按顺序处理文件，确认报文一般与最早发送的文件对应，从队头开始查找，通常第一个就匹配。
+    auto it=m_inflight.begin();
+    for (;it!=m_inflight.end();++it)
+    {
+        if (msg.seq!=0) { if (it->seq==msg.seq) break; }
+        else            { if (it->filename==msg.filename) break; }
+    }
+
+    if (it==m_inflight.end()) return false;
+
+    item=move(*it);
+    m_bytes=m_bytes-item.filesize;
+    m_inflight.erase(it);
+
+    return true;
+}
+
 bool copyfile(const string &srcfilename,const string &dstfilename)
 {
     // 创建目标文件的目录。
@@ -71,6 +71,26 @@ string    picknumber(const string &src,const bool bsigned=false,const bool bdot=
 // rules：匹配规则的表达式，用星号"*"代表任意字符，多个表达式之间用半角的逗号分隔，如"*.h,*.cpp"。
 // 注意：1）str参数不需要支持"*"，rules参数支持"*"；2）函数在判断str是否匹配rules的时候，会忽略字母的大小写。
 bool matchstr(const string &str,const string &rules);
+
+// 预先编译的匹配规则，规则的写法与matchstr()函数相同。
+// compile()把规则拆分好并转换成大写，match()不再拆分规则，比较时逐个字符忽略大小写，不分配内存。
+// 同一个规则要匹配大量字符串的时候（例如扫描目录）用它代替matchstr()。
+class cmatchstr
+{
+private:
+    vector<vector<string>> m_rules;     // 用逗号拆分后的每个表达式，再用星号拆分成多段。
+public:
+    cmatchstr() {}
+    cmatchstr(const string &rules) { compile(rules); }
+
+    // 编译匹配规则，rules为空时不能匹配任何字符串。
+    void compile(const string &rules);
+
+    // 判断str是否匹配规则。
+    bool match(const char *str,const size_t len) const;
+    bool match(const char *str) const { return match(str,strlen(str)); }
+    bool match(const string &str) const { return match(str.c_str(),str.length()); }
+};
 ///////////////////////////////////// /////////////////////////////////////
 
 ///////////////////////////////////// /////////////////////////////////////
@@ -146,6 +166,44 @@ bool getxmlbuffer(const string &xmlbuffer,const string &fieldname,long &value);
 bool getxmlbuffer(const string &xmlbuffer,const string &fieldname,unsigned long &value);
 bool getxmlbuffer(const string &xmlbuffer,const string &fieldname,double &value);
 bool getxmlbuffer(const string &xmlbuffer,const string &fieldname,float &value);
+
+// 一次扫描解析一条xml格式的记录，把每个字段的标签名和内容的位置存放在字段表中，不复制字段的内容。
+// getxmlbuffer()每提取一个字段都要从头查找一遍，从一条记录中提取n个字段的代价与n乘以记录的长度成正比，
+// cxmlrecord只扫描记录一次，代价与记录的长度成正比，适用于从同一条记录中提取很多字段的场景，例如xmltodb。
+// 只解析一层标签，不支持嵌套，<endl/>这样的自闭合标签被忽略，标签名区分大小写，与getxmlbuffer()相同。
+// 注意：字段表中存放的是指向记录的指针，使用字段表期间，记录的内存不能释放或修改。
+class cxmlrecord
+{
+public:
+    struct st_field
+    {
+        const char *name;       // 标签名。
+        size_t     namelen;     // 标签名的长度。
+        const char *value;      // 字段的内容。
+        size_t     valuelen;    // 字段内容的长度。
+    };
+private:
+    vector<st_field> m_fields;  // 字段表，按字段在记录中出现的顺序存放。
+    size_t m_hint;              // 上一次找到的字段的下一个位置，字段通常按顺序提取，从这里开始查找。
+public:
+    cxmlrecord():m_hint(0) {}
+
+    // 解析一条记录，返回字段的个数。
+    size_t parse(const char *buffer,const size_t len);
+    size_t parse(const string &buffer) { return parse(buffer.c_str(),buffer.length()); }
+    size_t parse(string &&buffer) = delete;   // 临时对象解析完就被释放了，字段表会指向无效的内存。
+
+    size_t size() const { return m_fields.size(); }
+    const st_field &operator[](const size_t ii) const { return m_fields[ii]; }
+
+    // 查找标签名为name的字段，找不到返回nullptr。
+    const st_field *find(const char *name,const size_t namelen);
+    const st_field *find(const string &name) { return find(name.c_str(),name.length()); }
+
+    // 获取字段的内容，与getxmlbuffer()的string版本相同，ilen限定内容的长度，0表示不限长度。
+    // 返回值：true-成功；标签名不存在返回false。
+    bool getvalue(const string &name,string &value,const int ilen=0);
+};
 ///////////////////////////////////// /////////////////////////////////////
 
 // C++格式化输出函数模板。
@@ -277,7 +335,7 @@ bool copyfile(const string &srcfilename,const string &dstfilename);
 // 获取文件的大小。
 // filename：待获取的文件名，建议采用绝对路径的文件名。
 // 返回值：如果文件不存在或没有访问权限，返回-1，成功返回文件的大小，单位是字节。
-int filesize(const string &filename);
+long filesize(const string &filename);
 
 // 获取文件的时间。
 // filename：待获取的文件名，建议采用绝对路径的文件名。
@@ -303,6 +361,20 @@ private:
     int m_pos;                          // 从文件列表m_filelist中已读取文件的位置。
     string m_fmt;                     // 文件时间格式，缺省"yyyymmddhh24miss"。
 
+    // 流方式读取目录时，已打开的一级目录。
+    struct st_dirstream
+    {
+        int    fd;                    // 目录的文件描述符。
+        string dirname;               // 目录名。
+        vector<char> buffer;          // 存放getdents64()读取的目录项。
+        int    pos;                   // buffer中下一个目录项的位置。
+        int    len;                   // buffer中有效数据的长度。
+    };
+    vector<st_dirstream> m_streams;   // 已打开的各级目录，最后一个是正在读取的目录。
+    bool   m_bstream;                 // 是否以流的方式读取目录。
+    cmatchstr m_rules;                // 流方式下文件名的匹配规则。
+    bool   m_andchild;                // 流方式下是否读取各级子目录。
+
     cdir(const cdir &) = delete;                      // 禁用拷贝构造函数。
     cdir &operator=(const cdir &) = delete;  // 禁用赋值函数。
 public:
@@ -310,12 +382,15 @@ public:
     string m_dirname;        // 目录名，例如：/project/public
     string m_filename;       // 文件名，不包括目录名，例如：_public.h
     string m_ffilename;      // 绝对路径的文件，例如：/project/public/_public.h
-    int      m_filesize;          // 文件的大小，单位：字节。
+    long     m_filesize;          // 文件的大小，单位：字节。
     string m_mtime;           // 文件最后一次被修改的时间，即stat结构体的st_mtime成员。
     string m_ctime;            // 文件生成的时间，即stat结构体的st_ctime成员。
     string m_atime;            // 文件最后一次被访问的时间，即stat结构体的st_atime成员。
+    time_t m_imtime;          // 整数表示的m_mtime。
+    time_t m_ictime;           // 整数表示的m_ctime。
+    time_t m_iatime;           // 整数表示的m_atime。
 
-    cdir():m_pos(0),m_fmt("yyyymmddhh24miss") {}  // 构造函数。
+    cdir():m_pos(0),m_fmt("yyyymmddhh24miss"),m_bstream(false),m_andchild(false) {}  // 构造函数。
 
     // 设置文件时间的格式，支持"yyyy-mm-dd hh24:mi:ss"和"yyyymmddhh24miss"两种，缺省是后者。
     void setfmt(const string &fmt);
@@ -326,23 +401,89 @@ public:
     // maxfiles，本次获取文件的最大数量，缺省值为10000个，如果文件太多，可能消耗太多的内存。
     // bandchild，是否打开各级子目录，缺省值为false-不打开子目录。
     // bsort，是否按文件名排序，缺省值为false-不排序。
+    // threads，扫描各级子目录的线程数，缺省值为1-不启用多线程，只有bandchild为true时才有效。
+    // 子目录很多并且在网络文件系统或很慢的磁盘上时，多个线程同时读取不同的子目录，可以大幅缩短扫描的时间。
+    // 多线程扫描时文件在m_filelist中的顺序是不确定的，如果需要固定的顺序，bsort设置为true。
     // 返回值：true-成功，false-失败。
-    bool opendir(const string &dirname,const string &rules,const int maxfiles=10000,const bool bandchild=false,bool bsort=false);
+    bool opendir(const string &dirname,const string &rules,const int maxfiles=10000,const bool bandchild=false,bool bsort=false,const int threads=1);
+
+    // 以流的方式打开目录，不获取文件列表，之后每调用一次readdir()从目录中读取一个文件。
+    // 目录项用getdents64()成批读取，文件信息用fstatat()相对目录的句柄获取，内存占用与文件的数量无关，
+    // 没有maxfiles的限制，适用于有几百万个文件的目录，但不能排序。
+    // 流方式下readdir()只填充m_imtime、m_ictime和m_iatime，需要字符串格式的时间时调用fmttime()。
+    // 参数的含义与opendir()相同，返回值：true-成功，false-失败。
+    bool opendirstream(const string &dirname,const string &rules,const bool bandchild=false);
 
 private:
     // 这是一个递归函数，被opendir()的调用，在cdir类的外部不需要调用它。
-    bool _opendir(const string &dirname,const string &rules,const int maxfiles,const bool bandchild);
+    bool _opendir(const string &dirname,const cmatchstr &rules,const int maxfiles,const bool bandchild);
+
+    // 用多个线程扫描dirname目录和它的各级子目录，被opendir()调用。
+    bool _opendirparallel(const string &dirname,const cmatchstr &rules,const int maxfiles,const int threads);
+
+    // 流方式下的readdir()，被readdir()调用。
+    bool readdirstream();
+
+    // 关闭流方式下已打开的各级目录。
+    void closestream();
 
 public:
     // 从m_filelist容器中获取一条记录（文件名），同时获取该文件的大小、修改时间等信息。
     // 调用opendir方法时，m_filelist容器被清空，m_pos归零，每调用一次readdir方法m_pos加1。
     // 当m_pos小于m_filelist.size()，返回true，否则返回false。
+    // 流方式下从目录中读取下一个文件，目录已读完时返回false。
     bool readdir();
 
-    unsigned int size() { return m_filelist.size(); }
+    // 把m_imtime、m_ictime和m_iatime按setfmt()设置的格式转换为m_mtime、m_ctime和m_atime。
+    void fmttime();
+
+    unsigned int size() { return m_filelist.size(); }   // 流方式下总是0。
 
     ~cdir();  // 析构函数。
 };
+
+// 监视目录中新文件的类，用inotify实现，与cdir类配合使用。
+// 文件写入完成（IN_CLOSE_WRITE）或移入目录（IN_MOVED_TO）时产生事件，程序收到事件后再用cdir扫描目录，
+// 没有事件的时候不必定时扫描目录，也不必等到下一个扫描周期才发现新文件。
+// inotify感知不到网络文件系统中其它主机写入的文件，事件队列也可能溢出，所以每隔fullscan秒还是要扫描一次目录。
+// 如果系统不支持inotify，wait()就退化为sleep()，每次都要扫描目录，与原来的方式相同。
+class cdirwatch
+{
+private:
+    int    m_fd;                        // inotify的句柄，-1表示未监视。
+    unordered_map<int,string> m_wds;    // 监视描述符与目录名的对应关系。
+    cmatchstr m_rules;                  // 文件名的匹配规则，不匹配的文件的事件将被忽略。
+    bool   m_andchild;                  // 是否监视各级子目录。
+    int    m_fullscan;                  // 全量扫描目录的时间间隔，单位：秒。
+    time_t m_lastscan;                  // 上一次通知调用者扫描目录的时间。
+
+    cdirwatch(const cdirwatch &) = delete;                  // 禁用拷贝构造函数。
+    cdirwatch &operator=(const cdirwatch &) = delete;       // 禁用赋值函数。
+
+    // 监视一个目录，如果m_andchild为true，还要监视它的各级子目录。
+    bool addwatch(const string &dirname);
+public:
+    cdirwatch():m_fd(-1),m_andchild(false),m_fullscan(60),m_lastscan(0) {}
+
+    // 开始监视目录。
+    // dirname：目录名，采用绝对路径，与cdir::opendir()的参数相同。
+    // rules：文件名的匹配规则，与cdir::opendir()的参数相同。
+    // bandchild：是否监视各级子目录，新建的子目录也会被监视。
+    // fullscan：全量扫描目录的时间间隔，单位：秒，缺省60秒。
+    // 返回值：true-成功，false-失败，失败后wait()按sleep()的方式工作，程序仍可以正常运行。
+    bool watch(const string &dirname,const string &rules,const bool bandchild=false,const int fullscan=60);
+
+    // 等待目录中的新文件，最多等待timeout秒。
+    // 返回值：true-调用者应该扫描目录，有三种情况：1）有新文件；2）距离上一次扫描目录已超过fullscan秒；3）未能监视目录。
+    //        false-超时或被信号中断，目录中没有新文件，调用者不必扫描目录。
+    bool wait(const int timeout);
+
+    bool iswatching() const { return m_fd!=-1; }    // 是否正在监视目录。
+
+    void close();     // 停止监视目录。
+
+   ~cdirwatch();
+};
 ///////////////////////////////////// /////////////////////////////////////
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
@@ -396,6 +537,109 @@ public:
 };
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// 把xml格式的记录写入文件的类，与cxmlrecord相反。
+// cofile::writeline()每写一个字段都要调用sformat()，格式化两次并分配一个string，
+// cxmlwriter把标签和内容直接追加到缓冲区中，缓冲区满了再一次写入文件，适用于输出大量记录的场景，例如dminingoracle。
+// 缓冲区在多个文件之间重用，不会反复分配内存。
+// 注意：关闭文件之前，必须调用flush()把缓冲区中的数据写入文件。
+class cxmlwriter
+{
+private:
+    cofile *m_ofile;            // 输出的文件。
+    string  m_buffer;           // 缓冲区。
+    size_t  m_bufsize;          // 缓冲区中的数据达到这个大小就写入文件。
+public:
+    cxmlwriter():m_ofile(nullptr),m_bufsize(0) {}
+
+    // 指定输出的文件，bufsize为缓冲区的大小，缺省1M。
+    // 如果缓冲区中还有数据没有写入，先写入之前的文件。
+    bool attach(cofile &ofile,const size_t bufsize=1024*1024);
+
+    // 写入一个字段：<name>value</name>。
+    void addfield(const char *name,const size_t namelen,const char *value,const size_t valuelen)
+    {
+        m_buffer.append(1,'<').append(name,namelen).append(1,'>');
+        m_buffer.append(value,valuelen);
+        m_buffer.append("</",2).append(name,namelen).append(1,'>');
+    }
+    void addfield(const string &name,const char *value) { addfield(name.c_str(),name.length(),value,strlen(value)); }
+
+    // 原样写入一段文本，例如"<data>\n"。
+    void addstr(const char *str,const size_t len) { m_buffer.append(str,len); }
+    void addstr(const string &str) { m_buffer.append(str); }
+
+    // 写入记录结束的标志"<endl/>\n"，缓冲区满了就写入文件。
+    // 返回值：false-写入文件失败。
+    bool endrecord()
+    {
+        m_buffer.append("<endl/>\n",8);
+
+        if (m_buffer.length() < m_bufsize) return true;
+
+        return flush();
+    }
+
+    // 把缓冲区中的数据写入文件。
+    bool flush();
+};
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// 二进制格式的数据文件，与xml格式的<data>...<endl/>相比，没有标签，不需要解析，文件小很多，可以按块压缩。
+// 文件是自描述的，文件头中有字段名和字段长度，读取的一方根据字段名找字段，与xml格式相同。
+// 文件头：4字节"IDCB"，1字节版本号（1），1字节标志（BINFILE_COMPRESS），2字节字段数n，
+//         n个字段，每个字段：1字节字段名的长度、字段名、2字节字段的最大长度。
+// 数据块：4字节记录数、4字节原始长度、4字节存储长度、存储的数据，重复到文件结束。
+//         存储长度与原始长度相同表示这个数据块没有压缩，否则用zlib压缩。
+// 记录：n个字段依次存放，每个字段：2字节内容的长度、内容。
+// 整数都采用小端字节序。
+const int BINFILE_COMPRESS=1;   // 文件头的标志：数据块用zlib压缩。
+
+// 写入二进制格式数据文件的类，用法与cxmlwriter相同。
+// 注意：关闭文件之前，必须调用flush()把缓冲区中的数据写入文件。
+class cbinwriter
+{
+private:
+    cofile  *m_ofile;           // 输出的文件。
+    string  m_buffer;           // 缓冲区，存放一个数据块的记录。
+    string  m_zbuffer;          // 压缩后的数据块。
+    size_t  m_bufsize;          // 缓冲区中的数据达到这个大小就写入文件。
+    unsigned int m_rows;        // 缓冲区中的记录数。
+    bool    m_bcompress;        // 是否压缩数据块。
+public:
+    cbinwriter():m_ofile(nullptr),m_bufsize(0),m_rows(0),m_bcompress(false) {}
+
+    // 开始写一个文件，ofile必须已打开，names和lens是字段名和字段的最大长度，写入文件头。
+    // bcompress，是否压缩数据块；bufsize，数据块的大小，缺省1M。
+    // 如果缓冲区中还有数据没有写入，先写入之前的文件。
+    bool start(cofile &ofile,const vector<string> &names,const vector<int> &lens,
+               const bool bcompress=false,const size_t bufsize=1024*1024);
+
+    // 按文件头中字段的顺序写入一个字段的内容，超过65535字节的部分被截断。
+    void addfield(const char *value,size_t len)
+    {
+        if (len>65535) len=65535;
+        m_buffer.append(1,static_cast<char>(len&0xff)).append(1,static_cast<char>(len>>8));
+        m_buffer.append(value,len);
+    }
+
+    // 一条记录的字段都写完了，缓冲区满了就写入文件。
+    // 返回值：false-写入文件失败。
+    bool endrecord()
+    {
+        m_rows++;
+
+        if (m_buffer.length() < m_bufsize) return true;
+
+        return flush();
+    }
+
+    // 把缓冲区中的记录作为一个数据块写入文件。
+    bool flush();
+};
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 // 读取文件的类。
 class cifile    // class in file
@@ -428,6 +672,91 @@ public:
 
     ~cifile() { close(); }
 };
+
+// 用mmap读取文本文件的类，整个文件映射到内存中，按结尾标志切分记录。
+// readrecord()返回记录在映射区中的地址和长度，不复制数据，也没有cifile::readline()逐行拼接字符串的开销，
+// 适用于几百MB的大文件，例如xmltodb的xml文件。
+// 注意：readrecord()返回的地址在close()之前有效。
+class cmmapfile
+{
+private:
+    int    m_fd;                 // 文件描述符。
+    char   *m_data;              // 映射区的起始地址。
+    size_t m_size;               // 文件的大小。
+    size_t m_pos;                // 下一条记录在映射区中的位置。
+    string m_filename;           // 文件名，建议采用绝对路径。
+
+    cmmapfile(const cmmapfile &) = delete;                  // 禁用拷贝构造函数。
+    cmmapfile &operator=(const cmmapfile &) = delete;       // 禁用赋值函数。
+public:
+    cmmapfile():m_fd(-1),m_data(nullptr),m_size(0),m_pos(0) {}
+
+    // 判断文件是否已打开。
+    bool isopen() const { return m_fd>=0; }
+
+    // 打开文件并映射到内存，空文件也能打开，只是读不到记录。
+    bool open(const string &filename);
+
+    // 读取一条以endbz结尾的记录，record和len存放记录的地址和长度，记录中包括endbz，不包括它后面的换行符。
+    // 与cifile::readline()相同，文件末尾没有结尾标志的内容被忽略。
+    // 返回值：true-成功；false-文件已读完。
+    bool readrecord(const char *&record,size_t &len,const string &endbz);
+
+    // 映射区的起始地址和文件的大小。
+    const char *data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+    // 关闭文件，解除映射。
+    void close();
+
+    ~cmmapfile() { close(); }
+};
+
+// 读取二进制格式数据文件的类，文件格式见cbinwriter。
+// 文件被映射到内存中，没有压缩的数据块直接从映射区读取，压缩的数据块一次解压一块。
+// 注意：value()返回的地址只在读取下一条记录之前有效。
+class cbinreader
+{
+private:
+    cmmapfile m_file;           // 映射到内存中的文件。
+    vector<string> m_names;     // 字段名。
+    vector<int>    m_lens;      // 字段的最大长度。
+    size_t m_pos;               // 下一个数据块在映射区中的位置。
+    string m_block;             // 解压后的数据块。
+    const char *m_ptr;          // 下一条记录的地址。
+    const char *m_end;          // 当前数据块的结束地址。
+    unsigned int m_rows;        // 当前数据块中还没有读取的记录数。
+    vector<pair<const char *,size_t>> m_values;   // 当前记录的字段的地址和长度。
+    bool m_bgood;               // 文件的格式是否正确。
+
+    bool readblock();           // 读取下一个数据块。
+public:
+    cbinreader():m_pos(0),m_ptr(nullptr),m_end(nullptr),m_rows(0),m_bgood(false) {}
+
+    // 打开文件并读取文件头，文件不存在或者不是二进制格式的数据文件返回false。
+    bool open(const string &filename);
+
+    // 字段数、字段名和字段的最大长度。
+    size_t fieldcount() const { return m_names.size(); }
+    const string &fieldname(const size_t ii) const { return m_names[ii]; }
+    int fieldlen(const size_t ii) const { return m_lens[ii]; }
+
+    // 查找字段名为name的字段，返回字段的序号，找不到返回-1。字段名区分大小写，与xml格式相同。
+    int findfield(const char *name) const;
+
+    // 读取下一条记录。
+    // 返回值：true-成功；false-文件已读完，或者文件的格式不正确，用good()区分。
+    bool next();
+
+    // 当前记录第ii个字段的内容和长度，内容不以0结尾。
+    const char *value(const size_t ii) const { return m_values[ii].first; }
+    size_t valuelen(const size_t ii) const { return m_values[ii].second; }
+
+    // 文件的格式是否正确，如果数据块不完整或者解压失败，返回false。
+    bool good() const { return m_bgood; }
+
+    void close();
+};
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
@@ -555,6 +884,16 @@ public:
     bool write(const string &buffer);                          // 发送文本数据。
     bool write(const void *buffer,const int ibuflen);   // 发送二进制数据。
 
+    // 向对端发送文件的内容，不发送报头，详见tcpsendfile()函数。
+    bool sendfile(const string &filename,const long filesize,const long offset=0);
+
+    // 接收对端发送过来的文件的内容，写入filename文件中，详见tcprecvfile()函数。
+    bool recvfile(const string &filename,const long filesize,const long offset=0);
+
+    // 压缩后发送文件的内容和接收压缩的文件内容，详见tcpsendfilez()和tcprecvfilez()函数。
+    bool sendfilez(const string &filename,const long filesize,const long offset=0);
+    bool recvfilez(const string &filename,const long filesize,const long offset=0);
+
     // 断开与服务端的连接
     void close();
 
@@ -586,6 +925,9 @@ public:
     // 返回值：客户端的ip地址，如"192.168.1.100"。
     char *getip();
 
+    // 获取服务端用于监听的socket，用于采用epoll等事件驱动方式的服务程序。
+    int listenfd() const { return m_listenfd; }
+
     // 接收对端发送过来的数据。
     // buffer：存放接收数据的缓冲区。
     // ibuflen: 打算接收数据的大小。
@@ -601,6 +943,16 @@ public:
     bool write(const string &buffer);                          // 发送文本数据。
     bool write(const void *buffer,const int ibuflen);   // 发送二进制数据。
 
+    // 向对端发送文件的内容，不发送报头，详见tcpsendfile()函数。
+    bool sendfile(const string &filename,const long filesize,const long offset=0);
+
+    // 接收对端发送过来的文件的内容，写入filename文件中，详见tcprecvfile()函数。
+    bool recvfile(const string &filename,const long filesize,const long offset=0);
+
+    // 压缩后发送文件的内容和接收压缩的文件内容，详见tcpsendfilez()和tcprecvfilez()函数。
+    bool sendfilez(const string &filename,const long filesize,const long offset=0);
+    bool recvfilez(const string &filename,const long filesize,const long offset=0);
+
     // 关闭监听的socket，即m_listenfd，常用于多进程服务程序的子进程代码中。
     void closelisten();
 
@@ -641,6 +993,132 @@ bool readn(const int sockfd,char *buffer,const size_t n);
 // 返回值：成功写入完n字节的数据后返回true，socket连接不可用返回false。
 bool writen(const int sockfd,const char *buffer,const size_t n);
 
+// 把文件的内容发送到socket的对端，用于传输文件，不发送报头。
+// sockfd：可用的socket连接。
+// filename：待发送的文件名，建议采用绝对路径的文件名。
+// filesize：文件的大小，单位：字节，发送文件中offset到filesize之间的内容。
+// offset：从文件的哪个位置开始发送，缺省是0，表示从头开始。
+// 返回值：true-成功；false-失败，失败的原因可能是文件打不开、文件被截断或socket连接已不可用。
+// 注意：优先采用sendfile(2)在内核中把文件的内容直接拷贝到socket，数据不经过用户空间，
+//       如果内核或文件系统不支持，改为用64K的缓冲区读文件再写入socket。
+bool tcpsendfile(const int sockfd,const string &filename,const long filesize,const long offset=0);
+
+// 从socket中接收对端发送过来的文件的内容，写入文件中，与tcpsendfile()函数配合使用。
+// sockfd：可用的socket连接。
+// filename：存放文件内容的文件名，建议采用绝对路径的文件名，一般是临时文件，接收完成后由调用者改名。
+// filesize：文件的大小，单位：字节，接收的内容写入文件中offset到filesize之间的位置。
+// offset：从文件的哪个位置开始写入，缺省是0，表示从头开始，此时文件原有的内容将被清空。
+// 返回值：true-成功；false-失败，失败的原因可能是文件打不开、磁盘空间不足或socket连接已不可用。
+// 注意：
+// 1）如果filename中的目录不存在，会自动创建。
+//    文件打不开或写入失败时，仍会把文件的内容从socket中接收完并丢弃，再返回false，调用者可以继续使用这个连接，
+//    只有socket连接不可用时才会提前返回。
+// 2）接收之前用fallocate()按filesize预分配磁盘空间，减少文件系统的碎片，如果文件系统不支持，忽略。
+// 3）优先采用splice(2)经过管道把数据从socket移动到文件，数据不经过用户空间，
+//    如果内核或文件系统不支持，改为用256K的缓冲区从socket读取数据再写入文件。
+bool tcprecvfile(const int sockfd,const string &filename,const long filesize,const long offset=0);
+
+// 把文件的内容用zlib压缩后发送到socket的对端，用于传输文件，与tcprecvfilez()配合使用。
+// 参数和返回值与tcpsendfile()相同，level是zlib的压缩级别，缺省是1，速度最快。
+// 压缩后的数据分成若干块发送，每块的格式与tcpwrite()相同：4字节的长度+压缩数据，最后发送一个长度为0的块表示结束，
+// 压缩后的大小事先并不知道，文件边压缩边发送，不需要临时文件，也不需要把整个文件读入内存。
+bool tcpsendfilez(const int sockfd,const string &filename,const long filesize,const long offset=0,const int level=1);
+
+// 从socket中接收tcpsendfilez()发送过来的压缩数据，解压后写入文件中。
+// 参数和返回值与tcprecvfile()相同，如果解压后的大小与filesize-offset不同，返回false。
+bool tcprecvfilez(const int sockfd,const string &filename,const long filesize,const long offset=0);
+
+// 判断文件是否值得压缩后再传输，已经是压缩格式的文件（如*.gz、*.zip、*.jpg）返回false。
+bool compressible(const string &filename);
+
+// 获取断点续传的位置，用于接收文件的一端。
+// filename：上次接收失败留下的临时文件名。
+// mtime：对端文件的时间，格式为yyyymmddhh24miss。
+// filesize：对端文件的大小。
+// 返回值：临时文件中已接收的字节数，如果临时文件不存在、时间与mtime不同或大小不小于filesize，返回0。
+// 注意：接收文件失败时，要保留临时文件，并把临时文件的时间设置为对端文件的时间，否则下次无法续传。
+long resumeoffset(const string &filename,const string &mtime,const long filesize);
+
+// 文件传输的控制报文，用于fileserver、tcpputfiles和tcpgetfiles。
+// 报文有两种格式，都用tcpwrite()和tcpread()收发，协议版本在登录时协商：
+// 1）协议版本1：xml格式，如<filename>a.txt</filename><filesize>100</filesize><mtime>20240101120000</mtime>。
+// 2）协议版本2：二进制格式，32字节的定长报文头+文件名，整数字段采用网络字节序，不需要拼接和查找xml标签。
+//    报文头：标识(1字节，固定是0xFE)+类型(1)+标志(1)+保留(1)+序号(4)+文件大小(8)+文件时间(8)+断点位置(8)。
+//    xml格式的报文以'<'或字母开头，收到报文时根据第一个字节就可以区分两种格式。
+const int PROTOVER=2;           // 本程序支持的最高协议版本。
+
+// 报文的类型。
+const int FMSG_ACTIVETEST=1;    // 心跳报文。
+const int FMSG_ACTIVEOK=2;      // 心跳报文的回应。
+const int FMSG_FILEHEAD=3;      // 文件信息，之后是文件的内容。
+const int FMSG_OFFSET=4;        // 断点续传的回应，offset是已接收的字节数。
+const int FMSG_ACK=5;           // 文件接收结果的确认报文。
+
+// 报文的标志位。
+const int FMSG_RESUME=1;        // 文件信息：协商断点续传的位置。
+const int FMSG_COMPRESS=2;      // 文件信息：文件的内容用zlib压缩。
+const int FMSG_SUCCESS=4;       // 确认报文：文件接收成功。
+
+struct st_filemsg
+{
+    int    type=0;              // 报文的类型，FMSG_ACTIVETEST等。
+    int    flags=0;             // 报文的标志位，FMSG_RESUME等的组合。
+    unsigned int seq=0;         // 报文的序号，断点续传的回应和确认报文的序号与文件信息报文相同，xml格式不传输。
+    long   filesize=0;          // 文件的大小。
+    string mtime;               // 文件的时间，格式为yyyymmddhh24miss，二进制格式中用整数表示。
+    long   offset=0;            // 断点续传的位置。
+    string filename;            // 文件名。
+};
+
+// 把报文打包成protover版本的格式，protover为1时是xml格式，为2时是二进制格式。
+// 返回值：false-报文的类型不正确或文件时间的格式不正确，true-成功。
+bool packfilemsg(const st_filemsg &msg,string &buffer,const int protover);
+
+// 解析tcpread()收到的报文，自动识别xml和二进制两种格式。
+// 返回值：false-报文的格式不正确，true-成功。
+bool unpackfilemsg(const string &buffer,st_filemsg &msg);
+
+// 文件传输的发送窗口，记录已发送但未收到确认报文的文件，用于fileserver和tcpputfiles。
+// 发送端每发送一个文件调用push()，收到确认报文调用ack()，full()返回true时要先等待确认报文再发送。
+// 限制在途的文件数，可以避免确认报文在发送端的接收缓冲区中积压，接收端因写不出确认报文而阻塞。
+class csendwindow
+{
+public:
+    struct st_inflight
+    {
+        unsigned int seq;       // 文件信息报文的序号。
+        string filename;        // 文件名。
+        long   filesize;        // 文件的大小。
+    };
+private:
+    deque<st_inflight> m_inflight;    // 在途的文件，按发送的先后排列。
+    size_t m_maxfiles;               // 在途文件数的上限。
+    long   m_maxbytes;               // 在途字节数的上限。
+    long   m_bytes;                  // 在途的字节数。
+public:
+    // maxfiles：在途文件数的上限，maxbytes：在途字节数的上限。
+    csendwindow(const size_t maxfiles=1000,const long maxbytes=268435456):m_maxfiles(maxfiles),m_maxbytes(maxbytes),m_bytes(0) {}
+
+    void setlimits(const size_t maxfiles,const long maxbytes) { m_maxfiles=maxfiles; m_maxbytes=maxbytes; }
+
+    // 窗口是否已满，窗口为空时总是可以发送，所以超过maxbytes的大文件也能发送。
+    bool full() const { return (m_inflight.empty()==false) && ( (m_inflight.size()>=m_maxfiles) || (m_bytes>=m_maxbytes) ); }
+    bool empty() const { return m_inflight.empty(); }
+    size_t size() const { return m_inflight.size(); }
+    long bytes() const { return m_bytes; }
+
+    // 把已发送的文件加入窗口。
+    void push(const unsigned int seq,const string &filename,const long filesize);
+
+    // 用确认报文从窗口中取出对应的文件，存放在item中。
+    // 确认报文有序号时按序号匹配，旧版本的对端不回传序号（xml格式），按文件名匹配。
+    // 返回值：false-窗口中没有与确认报文对应的文件，true-成功。
+    bool ack(const st_filemsg &msg,st_inflight &item);
+
+    // 清空窗口。
+    void clear() { m_inflight.clear(); m_bytes=0; }
+};
+
 // 以上是socket通讯的函数和类
 ///////////////////////////////////// /////////////////////////////////////
 
@@ -30,7 +30,8 @@ OCI_ROWCBK_DONE       -24201  // done with user row callback
 int oci_init(LOGINENV *env)
 {
     //初始化Oracle 环境变量
-    int oci_ret = OCIEnvCreate(&env->envhp,OCI_DEFAULT,NULL,NULL,NULL,NULL,0,NULL);
+    // OCI_THREADED：多个线程各自使用自己的连接时，由OCI保护进程内共享的数据结构。
+    int oci_ret = OCIEnvCreate(&env->envhp,OCI_THREADED,NULL,NULL,NULL,NULL,0,NULL);
 
     if ( oci_ret != OCI_SUCCESS && oci_ret != OCI_SUCCESS_WITH_INFO ) 
     {
@@ -349,6 +350,9 @@ sqlstatement::sqlstatement()
     strncpy(m_cda.message,"sqlstatement not connect to connection.\n",128);
 
     m_lob=0;
+
+    m_fetched=0;
+    m_eof=false;
 }
 
 sqlstatement::sqlstatement(connection *conn)
@@ -364,6 +368,9 @@ sqlstatement::sqlstatement(connection *conn)
 
     m_lob=0;
 
+    m_fetched=0;
+    m_eof=false;
+
     connect(conn);
 }
 
@@ -492,6 +499,9 @@ int sqlstatement::prepare(const char *fmt,...)
 
     m_sql.clear();
 
+    // 新的SQL语句需要重新绑定输出变量的数组。
+    m_arraydefs.clear();
+
     va_list ap;
     va_start(ap,fmt);
     int len=vsnprintf(nullptr,0,fmt,ap);
@@ -578,6 +588,13 @@ int sqlstatement::bindin1(const unsigned int position,string &value)
                         SQLT_STR, NULL, NULL,NULL,0, NULL, OCI_DEFAULT);  
 }
 
+int sqlstatement::bindinarray(const unsigned int position,char *value,unsigned int len)
+{
+    // 数组中每个元素的大小是len+1，OCI按元素的大小计算下一条记录的地址。
+    return OCIBindByPos(m_handle.smthp, &m_handle.bindhp, m_handle.errhp, (ub4)position, value, len+1,
+                        SQLT_STR, NULL, NULL,NULL,0, NULL, OCI_DEFAULT);  
+}
+
 int sqlstatement::bindout(const unsigned int position,int &value)
 {
     return OCIDefineByPos(m_handle.smthp, &m_handle.defhp, m_handle.errhp, position, &value, sizeof(value), 
@@ -626,6 +643,35 @@ int sqlstatement::bindout(const unsigned int position,string &value,unsigned int
                           SQLT_STR, NULL, NULL, NULL, OCI_DEFAULT );
 }
 
+int sqlstatement::bindoutarray(const unsigned int position,char *value,unsigned int len,const unsigned int arraysize)
+{
+    if (position == 0) return -1;
+
+    if (m_arraydefs.size() < position) m_arraydefs.resize(position);
+
+    st_arraydef &arraydef=m_arraydefs[position-1];
+    arraydef.value=value;
+    arraydef.len=len;
+    arraydef.ind.assign(arraysize,0);
+
+    // 数组中每个元素的大小是len+1，OCI按元素的大小计算下一条记录的地址。
+    return OCIDefineByPos(m_handle.smthp, &m_handle.defhp, m_handle.errhp, position, value, len+1, 
+                          SQLT_STR, &arraydef.ind[0], NULL, NULL, OCI_DEFAULT );
+}
+
+int sqlstatement::setprefetch(const unsigned int rows,const unsigned int memory)
+{
+    if (m_state == disconnected) return -1;
+
+    ub4 prefetchrows=rows;
+    ub4 prefetchmemory=memory;
+
+    int oci_ret = OCIAttrSet(m_handle.smthp,OCI_HTYPE_STMT,&prefetchrows,0,OCI_ATTR_PREFETCH_ROWS,m_handle.errhp);
+    if ( oci_ret != OCI_SUCCESS && oci_ret != OCI_SUCCESS_WITH_INFO ) return oci_ret;
+
+    return OCIAttrSet(m_handle.smthp,OCI_HTYPE_STMT,&prefetchmemory,0,OCI_ATTR_PREFETCH_MEMORY,m_handle.errhp);
+}
+
 int sqlstatement::bindblob()
 {
     alloclob();
@@ -646,6 +692,8 @@ int sqlstatement::execute()
 {
     memset(&m_cda,0,sizeof(m_cda));
 
+    m_eof=false;
+
     if (m_state == disconnected) 
     {
         m_cda.rc=-1; strncpy(m_cda.message,"cursor not open.\n",128); return -1;
@@ -694,6 +742,85 @@ int sqlstatement::execute(const char *fmt,...)
     return execute();
 }
 
+int sqlstatement::executearray(const unsigned int iters)
+{
+    memset(&m_cda,0,sizeof(m_cda));
+
+    m_dmlerrors.clear();
+
+    if (m_state == disconnected) 
+    {
+        m_cda.rc=-1; strncpy(m_cda.message,"cursor not open.\n",128); return -1;
+    }
+
+    // 查询语句不能用数组的方式执行。
+    if (m_sqltype == false)
+    {
+        m_cda.rc=-1; strncpy(m_cda.message,"executearray() not support select.\n",128); return -1;
+    }
+
+    if (iters == 0) return 0;
+
+    // OCI_BATCH_ERRORS：个别记录失败时，其它记录继续执行，失败的记录在执行完成后统一获取。
+    ub4 mode=OCI_BATCH_ERRORS;
+
+    if (m_autocommitopt==true) mode=mode|OCI_COMMIT_ON_SUCCESS;
+
+    int oci_ret = OCIStmtExecute(m_handle.svchp,m_handle.smthp,m_handle.errhp,iters,0,NULL,NULL,mode);
+
+    // 获取成功记录的行数。
+    OCIAttrGet((CONST dvoid *)m_handle.smthp,OCI_HTYPE_STMT,(dvoid *)&m_cda.rpc, (ub4 *)0,
+              OCI_ATTR_ROW_COUNT, m_handle.errhp);
+    m_conn->m_cda.rpc=m_cda.rpc;
+
+    // 获取失败记录的数量，如果是0，并且OCIStmtExecute也失败了，表示整个语句都没有执行。
+    ub4 numerrs=0;
+    OCIAttrGet((CONST dvoid *)m_handle.smthp,OCI_HTYPE_STMT,(dvoid *)&numerrs, (ub4 *)0,
+              OCI_ATTR_NUM_DML_ERRORS, m_handle.errhp);
+
+    if (numerrs == 0)
+    {
+        if ( oci_ret != OCI_SUCCESS && oci_ret != OCI_SUCCESS_WITH_INFO )
+        {
+            err_report(); return m_cda.rc;
+        }
+
+        return 0;
+    }
+
+    // 逐条获取失败记录的下标和错误信息，每条失败记录对应一个错误句柄。
+    OCIError *errhp=0;
+    if (OCIHandleAlloc(m_handle.envhp,(dvoid**)&errhp,OCI_HTYPE_ERROR,(size_t)0,NULL) != OCI_SUCCESS)
+    {
+        err_report(); return m_cda.rc;
+    }
+
+    char message[1024];
+
+    for (ub4 ii=0;ii<numerrs;ii++)
+    {
+        DML_ERROR dmlerror;
+        ub4 rowoffset=0;
+
+        OCIParamGet(m_handle.errhp,OCI_HTYPE_ERROR,m_handle.errhp,(dvoid**)&errhp,ii);
+        OCIAttrGet((CONST dvoid *)errhp,OCI_HTYPE_ERROR,(dvoid *)&rowoffset,(ub4 *)0,
+                  OCI_ATTR_DML_ROW_OFFSET,m_handle.errhp);
+
+        memset(message,0,sizeof(message));
+        dmlerror.rc=0;
+        OCIErrorGet(errhp,1,NULL,&dmlerror.rc,(OraText*)message,sizeof(message),OCI_HTYPE_ERROR);
+
+        dmlerror.row=rowoffset;
+        dmlerror.message=message;
+
+        m_dmlerrors.push_back(std::move(dmlerror));
+    }
+
+    OCIHandleFree(errhp,OCI_HTYPE_ERROR);
+
+    return 0;
+}
+
 int sqlstatement::next() 
 { 
     // 注意，在该函数中，不可用memset(&m_cda,0,sizeof(m_cda))，否则会清空m_cda.rpc的内容
@@ -734,6 +861,72 @@ int sqlstatement::next()
     return 0;
 }
 
+int sqlstatement::nextarray(const unsigned int arraysize) 
+{ 
+    // 注意，在该函数中，不可用memset(&m_cda,0,sizeof(m_cda))，否则会清空m_cda.rpc的内容
+    m_fetched=0;
+
+    if (m_state == disconnected) 
+    {
+        m_cda.rc=-1; strncpy(m_cda.message,"cursor not open.\n",128); return -1;
+    }
+
+    // 如果语句未执行成功，直接返回失败。
+    if (m_cda.rc != 0) return m_cda.rc;
+
+    // 判断是否是查询语句，如果不是，直接返回错误
+    if (m_sqltype == true)
+    {
+        m_cda.rc=-1; strncpy(m_cda.message,"no recordset found.\n",128); return -1;
+    }
+
+    // 上一次已取出结果集的最后一批记录，结果集已结束，不能再调用OCIStmtFetch。
+    if (m_eof == true)
+    {
+        m_cda.rc=1403; strncpy(m_cda.message,"ORA-01403: no data found\n",128); return 1403;
+    }
+
+    int oci_ret = OCIStmtFetch(m_handle.smthp,m_handle.errhp,arraysize,OCI_FETCH_NEXT,OCI_DEFAULT);
+
+    // 获取本次取到的记录数，结果集的最后一批记录，OCIStmtFetch返回OCI_NO_DATA，但记录数大于0。
+    ub4 rows=0;
+    OCIAttrGet((CONST dvoid *)m_handle.smthp,OCI_HTYPE_STMT,(dvoid *)&rows, (ub4 *)0,
+                OCI_ATTR_ROWS_FETCHED, m_handle.errhp);
+
+    if ( oci_ret != OCI_SUCCESS && oci_ret != OCI_SUCCESS_WITH_INFO && (oci_ret != OCI_NO_DATA || rows == 0) )
+    {
+        err_report(); 
+
+        // 1406（字段的值被截断）不算错，其它错误返回失败，返回错误的时候，不要清空了m_cda.rpc
+        if (m_cda.rc != 1406) return m_cda.rc;
+    }
+
+    // 最后一批记录，下一次调用直接返回1403。
+    if (oci_ret == OCI_NO_DATA) m_eof=true;
+
+    m_cda.rc=0;
+    m_fetched=rows;
+
+    // 字段的值为空时，OCI不会修改数组中的元素，这里把它置为空字符串。
+    for (auto &arraydef:m_arraydefs)
+    {
+        if (arraydef.value == 0) continue;
+
+        for (ub4 ii=0;ii<rows;ii++)
+        {
+            if (arraydef.ind[ii] == -1) arraydef.value[ii*(arraydef.len+1)]=0;
+        }
+    }
+
+    // 获取影响记录的行数据。
+    OCIAttrGet((CONST dvoid *)m_handle.smthp,OCI_HTYPE_STMT,(dvoid *)&m_cda.rpc, (ub4 *)0,
+                OCI_ATTR_ROW_COUNT, m_handle.errhp);
+
+    m_conn->m_cda.rpc=m_cda.rpc;
+
+    return 0;
+}
+
 void sqlstatement::err_report()
 {
     // 注意，在该函数中，不可随意用memset(&m_cda,0,sizeof(m_cda))，否则会清空m_cda.rpc的内容
@@ -979,4 +1172,143 @@ int sqlstatement::lobtofile(FILE *fp)
     return 0;
 }
 
-}   // end namespace idc
\ No newline at end of file
+connpool::connpool()
+{
+    m_maxconns=0;
+    m_timeout=0;
+    m_conns=nullptr;
+}
+
+connpool::~connpool()
+{
+    destroy();
+}
+
+bool connpool::init(const string &connstr,const string &charset,const int maxconns,const int timeout)
+{
+    if ( (connstr.empty()==true) || (maxconns<=0) || (timeout<=0) ) return false;
+
+    destroy();
+
+    m_connstr=connstr;
+    m_charset=charset;
+    m_maxconns=maxconns;
+    m_timeout=timeout;
+
+    m_conns=new st_conn[m_maxconns];
+    for (int ii=0;ii<m_maxconns;ii++) { m_conns[ii].inuse=false; m_conns[ii].atime=0; }
+
+    return true;
+}
+
+bool connpool::connect(st_conn &sc)
+{
+    if (sc.conn.connecttodb(m_connstr,m_charset)!=0)
+    {
+        lock_guard<mutex> lock(m_mtx);
+        m_message=sc.conn.message();
+        sc.atime=0;
+        return false;
+    }
+
+    sc.atime=time(0);
+
+    return true;
+}
+
+connection *connpool::get()
+{
+    if (m_conns==nullptr) return nullptr;
+
+    int pos=-1;            // 取出的连接的位置。
+
+    // 在锁内只挑选连接并把它标记为已取出，检查连接和登录数据库比较慢，在锁外进行。
+    {
+        lock_guard<mutex> lock(m_mtx);
+
+        // 优先取出已登录数据库的空闲连接，没有的话，取出第一个还没有登录数据库的连接。
+        for (int ii=0;ii<m_maxconns;ii++)
+        {
+            if (m_conns[ii].inuse==true) continue;   // 连接正在被使用。
+
+            if (m_conns[ii].atime>0) { pos=ii; break; }
+
+            if (pos==-1) pos=ii;
+        }
+
+        if (pos==-1) { m_message="connpool is busy"; return nullptr; }
+
+        m_conns[pos].inuse=true;
+    }
+
+    st_conn &sc=m_conns[pos];
+
+    // 检查连接是否可用，数据库重启或者网络断开后，连接已失效，重新登录。
+    if ( (sc.atime>0) && (sc.conn.execute("select 1 from dual")!=0) ) sc.conn.disconnect();
+
+    // 还没有登录或者已失效的连接，登录数据库，失败的原因已保存在m_message中。
+    if ( (sc.conn.isopen()==false) && (connect(sc)==false) )
+    {
+        lock_guard<mutex> lock(m_mtx);
+        sc.inuse=false;
+        return nullptr;
+    }
+
+    sc.atime=time(0);
+
+    return &sc.conn;
+}
+
+void connpool::free(connection *conn)
+{
+    for (int ii=0;ii<m_maxconns;ii++)
+    {
+        if (&m_conns[ii].conn!=conn) continue;
+
+        conn->rollback();       // 回滚未提交的事务，下一个使用者不会受影响。
+
+        lock_guard<mutex> lock(m_mtx);
+        m_conns[ii].atime=time(0);
+        m_conns[ii].inuse=false;
+        return;
+    }
+}
+
+void connpool::checkpool()
+{
+    for (int ii=0;ii<m_maxconns;ii++)
+    {
+        // 空闲超时的连接先标记为已取出，在锁外断开，不影响其它线程取出连接。
+        {
+            lock_guard<mutex> lock(m_mtx);
+            if ( (m_conns[ii].inuse==true) || (m_conns[ii].atime==0) || (time(0)-m_conns[ii].atime<=m_timeout) ) continue;
+            m_conns[ii].inuse=true;
+        }
+
+        m_conns[ii].conn.disconnect();
+
+        lock_guard<mutex> lock(m_mtx);
+        m_conns[ii].atime=0;
+        m_conns[ii].inuse=false;
+    }
+}
+
+void connpool::destroy()
+{
+    if (m_conns==nullptr) return;
+
+    for (int ii=0;ii<m_maxconns;ii++)
+        m_conns[ii].conn.disconnect();
+
+    delete [] m_conns;
+    m_conns=nullptr;
+    m_maxconns=0;
+}
+
+string connpool::message()
+{
+    lock_guard<mutex> lock(m_mtx);
+    return m_message;
+}
+
+}   // end namespace idc
\ No newline at end of file
@@ -12,8 +12,10 @@
 #include <stdlib.h>
 #include <stdarg.h>
 #include <string>
+#include <vector>
 #include <oci.h>     // OCI的头文件。
 #include <mutex>   
+#include <time.h>
 
 using namespace std;
 
@@ -56,6 +58,13 @@ struct CDA_DEF       // OCI接口函数执行的结果。
     char     message[2048];  // 执行SQL语句如果失败，存放错误描述信息。
 };
 
+struct DML_ERROR     // 数组DML中某一行记录执行失败的信息。
+{
+    unsigned int row;     // 失败记录在绑定数组中的下标，从0开始。
+    int      rc;          // 错误代码，例如1-违反唯一性约束。
+    string   message;     // 错误描述信息。
+};
+
 int oci_init(LOGINENV *env);
 int oci_close(LOGINENV *env); 
 int oci_context_create(LOGINENV *env,OCI_CXT *cxt);
@@ -163,6 +172,19 @@ private:
     string m_sql;              // SQL语句的文本。
     CDA_DEF m_cda;       // 执行SQL语句的结果。
 
+    vector<DML_ERROR> m_dmlerrors;   // 数组DML中执行失败的记录。
+
+    // 用数组方式绑定的输出变量，nextarray()中需要根据指示器处理空值。
+    struct st_arraydef
+    {
+        char *value;          // 数组的首地址。
+        unsigned int len;     // 每个元素字符串的最大长度。
+        vector<sb2> ind;      // 每个元素的指示器，-1表示字段的值为空。
+    };
+    vector<st_arraydef> m_arraydefs;
+    unsigned int m_fetched;   // 最近一次nextarray()获取到的记录数。
+    bool m_eof;               // 结果集的最后一批记录已取出，不能再调用OCIStmtFetch，否则返回ORA-01002。
+
 public:
     sqlstatement();      // 构造函数。
     sqlstatement(connection *conn);    // 构造函数，同时指定数据库连接。
@@ -206,6 +228,14 @@ public:
     int bindin(const unsigned int position,string  &value,unsigned int len=2000);
     int bindin1(const unsigned int position,string  &value);   // 在这个函数中，不考虑分配内存的问题。
 
+    // 绑定输入变量的数组，用于数组DML，一次执行多条记录的insert、update和delete。
+    // position：字段的顺序，从1开始，必须与prepare方法中的SQL的序号一一对应。
+    // value：数组的首地址，数组中每个元素是一个字符串，占len+1字节，第ii条记录的值存放在value+ii*(len+1)处。
+    // len：每个元素字符串的最大长度，建议采用表对应的字段长度。
+    // 返回值：0-成功，其它失败，程序中一般不必关心返回值。
+    // 注意：调用者必须保证value的内存足够存放executearray()中指定的记录数，否则会内存越界。
+    int bindinarray(const unsigned int position,char *value,unsigned int len=2000);
+
     // 绑定输出变量的地址。
     // position：字段的顺序，从1开始，与SQL的结果集一一对应。
     // value：输出变量的地址，如果是字符串，内存大小应该是表对应的字段长度加1。
@@ -224,6 +254,22 @@ public:
     int bindout(const unsigned int position,char   *value,unsigned int len=2000); 
     int bindout(const unsigned int position,string  &value,unsigned int len=2000); 
 
+    // 绑定输出变量的数组，配合nextarray()方法使用，一次从结果集中获取多条记录。
+    // position：字段的顺序，从1开始，与SQL的结果集一一对应。
+    // value：数组的首地址，数组中每个元素是一个字符串，占len+1字节，第ii条记录的值存放在value+ii*(len+1)处。
+    // len：每个元素字符串的最大长度，建议采用表对应的字段长度，如果len的值太小，内容将会被截断。
+    // arraysize：数组的元素个数，调用者必须保证value的内存足够存放arraysize条记录。
+    // 返回值：0-成功，其它失败，程序中一般不必关心返回值。
+    // 注意：同一条SQL语句的全部输出变量都要用bindoutarray()绑定，并且arraysize要相同。
+    int bindoutarray(const unsigned int position,char *value,unsigned int len,const unsigned int arraysize);
+
+    // 设置查询语句的预取参数，调用next()时，OCI一次从数据库中预取多条记录缓存在客户端，减少网络往返。
+    // rows：预取的记录数，0表示不限制。
+    // memory：预取的内存大小，单位：字节，0表示不限制。
+    // 返回值：0-成功，其它失败，程序中一般不必关心返回值。
+    // 注意：在execute()方法之前调用，同一个sqlstatement只需要设置一次。
+    int setprefetch(const unsigned int rows,const unsigned int memory=0);
+
     // 执行静态或动态SQL语句。
     // 返回值：0-成功，其它失败，失败的代码在m_cda.rc中，失败的描述在m_cda.message中。
     // 如果成功的执行了非查询语句，在m_cda.rpc中保存了本次执行SQL影响记录的行数。
@@ -238,6 +284,17 @@ public:
     // 程序中必须检查execute方法的返回值。
     int execute(const char *fmt,...);
 
+    // 以数组的方式执行非查询语句，一次处理iters条记录，只产生一次网络往返。
+    // iters：本次执行的记录数，不能超过bindinarray()绑定数组的大小。
+    // 返回值：0-成功，其它失败，失败的代码在m_cda.rc中，失败的描述在m_cda.message中。
+    // 注意：1）只要SQL语句本身能执行，个别记录失败（例如违反唯一性约束）不算失败，返回值仍是0，
+    //           失败的记录用dmlerrors()获取，m_cda.rpc中保存了成功记录的行数；
+    //           2）如果返回失败，表示整个语句都没有执行，常见的原因是与数据库的连接已断开。
+    int executearray(const unsigned int iters);
+
+    // 获取最近一次executearray()中执行失败的记录。
+    const vector<DML_ERROR> &dmlerrors() { return m_dmlerrors; }
+
     // 从结果集中获取一条记录。
     // 如果执行的SQL语句是查询语句，调用execute方法后，会产生一个结果集（存放在数据库的缓冲区中）。
     // next方法从结果集中获取一条记录，把字段的值放入已绑定的输出变量中。
@@ -247,6 +304,17 @@ public:
     // 程序中必须检查next方法的返回值。
     int next();
 
+    // 从结果集中获取多条记录，存放在bindoutarray()绑定的数组中。
+    // arraysize：本次获取的最大记录数，不能超过bindoutarray()中的arraysize。
+    // 返回值：0-成功，1403-结果集已无记录，其它-失败，失败的代码在m_cda.rc中，失败的描述在m_cda.message中。
+    // 本次获取到的记录数用fetched()获取，可能小于arraysize，字段的值为空的元素是空字符串。
+    // 结果集的最后一批记录不足arraysize时也返回0，下一次调用返回1403，不会再从数据库获取。
+    // 每执行一次nextarray方法，m_cda.rpc的值加上本次获取到的记录数。
+    int nextarray(const unsigned int arraysize);
+
+    // 获取最近一次nextarray()获取到的记录数。
+    unsigned int fetched() { return m_fetched; }
+
     // 绑定clob字段。
     // 返回值：0-成功，其它失败，程序中一般不必关心返回值。
     int bindblob();
@@ -275,6 +343,65 @@ public:
     const char *message() { return m_cda.message; }
 };
 
+// 数据库连接池类。
+// 池中的连接在第一次取出时才登录数据库，用完之后归还到池中，不断开，下次取出时直接使用，不必重新登录。
+// 取出空闲的连接之前先检查它是否可用，数据库重启或网络断开后失效的连接会重新登录。
+// 空闲时间超过timeout的连接可以用checkpool()断开，释放数据库的会话资源。
+// 多个线程可以共用一个连接池，一个连接同时只能被一个线程使用。
+class connpool
+{
+private:
+    struct st_conn
+    {
+        connection conn;       // 数据库连接。
+        bool       inuse;      // 连接是否已被取出，由m_mtx保护。
+        time_t     atime;      // 连接最后一次使用的时间，0表示还没有登录数据库。
+    };
+
+    string   m_connstr;        // 数据库的登录参数。
+    string   m_charset;        // 客户端的字符集。
+    int      m_maxconns;       // 连接池中连接的最大数量。
+    int      m_timeout;        // 连接的空闲超时时间，单位：秒。
+    st_conn *m_conns;          // 连接池。
+
+    mutex    m_mtx;            // 保护各连接的inuse、空闲连接的atime和m_message。
+    string   m_message;        // 最近一次登录数据库失败的原因。
+
+    connpool(const connpool &) = delete;             // 禁用拷贝构造函数。
+    connpool &operator=(const connpool &) = delete;  // 禁用赋值函数。
+
+    // 登录数据库，失败的原因存放在m_message中。
+    bool connect(st_conn &sc);
+public:
+    connpool();
+   ~connpool();
+
+    // 初始化连接池，不会登录数据库。
+    // connstr和charset：与connection::connecttodb()相同。
+    // maxconns：连接池中连接的最大数量，缺省是10。
+    // timeout：连接的空闲超时时间，单位：秒，缺省是50。
+    // 返回值：true-成功；false-参数不正确。
+    bool init(const string &connstr,const string &charset,const int maxconns=10,const int timeout=50);
+
+    // 从连接池中取出一个连接。
+    // 优先取出已登录数据库的空闲连接，取出之前检查它是否可用，如果不可用，重新登录。
+    // 返回值：连接的地址；连接全部被占用或者登录数据库失败返回nullptr，失败的原因用message()获取。
+    // 注意：取出的连接用完之后必须调用free()归还。
+    connection *get();
+
+    // 把连接归还到连接池中，未提交的事务会被回滚。
+    void free(connection *conn);
+
+    // 断开空闲时间超过timeout的连接，一般由程序的主线程定时调用。
+    void checkpool();
+
+    // 断开全部的连接，释放连接池。
+    void destroy();
+
+    // 最近一次登录数据库失败的原因。
+    string message();
+};
+
 }  // end namespace idc
 #endif 
 
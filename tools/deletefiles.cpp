@@ -14,16 +14,19 @@ void EXIT(int sig); // 程序的退出函数
 
 int main(int argc, char* argv[])
 {
-    if (argc != 4)
+    if ((argc != 4) && (argc != 5))
     {
-        cout << "\n\nUsing:deletefiles pathname matchstr timeout\n\n"
+        cout << "\n\nUsing:deletefiles pathname matchstr timeout [threads]\n\n"
                 "Example:\n"
                 // 在R"()"里面的写字符串，特殊符号不需要转移转义，同时转义字符如\n也不会生效
                 R"(      /MDC/bin/tools/deletefiles /log/idc "*.log.20*" 0.02)"
-                "\n      /MDC/bin/tools/deletefiles /tmp/idc/surfdata \"*.xml,*.json\" 0.01\n\n"
+                "\n      /MDC/bin/tools/deletefiles /tmp/idc/surfdata \"*.xml,*.json\" 0.01\n"
+                "      /MDC/bin/tools/deletefiles /MDC/log \"*.log.20*\" 0.02 8\n\n"
 
                 "这是一个工具程序，用于删除历史的数据文件或日志文件\n"
                 "本程序把pathname目录及子目录中timeout天之前的匹配matchstr文件全部删除，timeout可以是小数\n"
+                "threads是扫描各级子目录的线程数，可选参数，子目录很多并且在网络文件系统或很慢的磁盘上时可以指定，\n"
+                "指定了threads时每次最多处理100万个文件，不指定时以流的方式扫描目录，文件的数量没有限制\n"
                 "本程序不写日志文件，也不会在控制台输出任何信息\n\n";              
 
         return -1;
@@ -34,31 +37,48 @@ int main(int argc, char* argv[])
     signal(SIGINT, EXIT);
     signal(SIGTERM, EXIT);
 
+    int threads = (argc == 5) ? atoi(argv[4]) : 1;
+
     // 配置进程心跳
-    pactive.addpinfo(30, "deletefiles");
+    // 多线程扫描时，全部的子目录扫描完才返回，扫描期间不能更新心跳，
+    // 100万个文件在网络文件系统或很慢的磁盘上可能要扫描几分钟，心跳的超时时间要足够长
+    pactive.addpinfo((threads > 1) ? 600 : 30, "deletefiles");
 
     // 获取被定义为历史数据文件的时间点
-    string timeout = ltime1("yyyymmddhh24miss", 0 - (int)(atof(argv[2]) * 24 * 60 * 60));
+    time_t timeout = time(0) - (time_t)(atof(argv[3]) * 24 * 60 * 60);
 
-    // 打开目录
-    // 每次最多删除10000个文件，因此不需要更新心跳
     cdir dir;
-    if (dir.opendir(argv[1], argv[2], 10000, true, false) == false)
+    if (threads > 1)
+    {
+        // 用多个线程扫描各级子目录，每次最多处理100万个文件
+        if (dir.opendir(argv[1], argv[2], 1000000, true, false, threads) == false)
+        {
+            printf("[open directory failed] dir.opendir(%s, %s)\n", argv[1], argv[2]);
+        }
+    }
+    else
     {
-        printf("[open directory failed] dir.opendir(%s, %s)\n", argv[1], argv[2]);
+        // 以流的方式打开目录，目录中的文件再多也不会占用太多内存，没有文件数量的限制
+        if (dir.opendirstream(argv[1], argv[2], true) == false)
+        {
+            printf("[open directory failed] dir.opendirstream(%s, %s)\n", argv[1], argv[2]);
+        }
     }
 
     // 遍历目的中的文件，如果是历史数据文件，删除它
     while (dir.readdir())
     {
-        // m_mtime是dir当前读取的文件的修改时间
-        if (dir.m_mtime < timeout)
+        // m_imtime是dir当前读取的文件的修改时间
+        if (dir.m_imtime < timeout)
         {
             if (remove(dir.m_ffilename.c_str()) == 0)
                 printf("remove %s success\n", dir.m_ffilename.c_str());
             else
                 printf("remove %s failed\n", dir.m_ffilename.c_str());
         }
+
+        // 文件数量没有限制，需要更新心跳
+        pactive.uptatime();
     }
 
     return 0;
@@ -12,6 +12,8 @@
     字段名列表以及对应的长度也需要传入
     同时，递增字段必须在查询的字段列表中，因为需要查询递增字段的值来更新最大值
     递增字段不是严格以1为间隔的，所以需要查询
+    输出的文件可以是xml格式或二进制格式（见_public.h中的cbinwriter），xmltodb根据文件名的后缀区分
+    增量抽取时可以指定pagesize参数分页抽取，每页保存一次最大值，或者指定parallel参数，把递增字段的范围分成多段，每段用一个线程和一个数据库连接同时抽取
 */
 #include "_public.h"
 #include "_ooci.h"
@@ -36,20 +38,43 @@ struct st_arg
     char connstr1[128];
     int timeout;
     char pname[64];
+    int fetchsize;          // 每次从结果集中获取的记录数。
+    int parallel;           // 并行抽取的线程数，缺省1。
+    int pagesize;           // 分页抽取时每页的记录数，缺省0，表示不分页。
+    char format[11];        // 输出文件的格式：xml-xml格式（缺省）；bin-二进制格式；binz-二进制格式，数据块用zlib压缩。
 }starg;
 
 clogfile logfile;       // 日志
 cpactive pactive;       // 进程心跳
 connection conn;        // 数据库连接
+connpool incpool;       // 存放递增字段最大值的数据库的连接池，分页抽取时每页都要保存最大值，从池中取连接，不必每次都登录数据库
+connpool partpool;      // 并行抽取时第2段及以后各段的数据库连接池，第1段使用conn
 
 ccmdstr fieldname;      // 用于存放字段名
 ccmdstr fieldlen;       // 用于存放字段长度
-int maxincvalue;        // 递增字段最大值
+long maxincvalue;       // 递增字段最大值，keyid一般取自序列，会超过int的范围
 int incfieldpos = -1;   // 递增字段在fieldstr中的位置
 
+// 抽取的一段记录，串行抽取时只有一段，并行抽取时每段一个线程，每个线程有自己的数据库连接，输出自己的文件序列
+struct st_part
+{
+    int id;                 // 段的编号，从1开始，串行抽取时为0
+    connection* conn;       // 数据库连接
+    long lower, upper;      // 递增字段的范围：lower<incfield<=upper，串行抽取时不使用
+    long maxincvalue;       // 本段已抽取的记录中递增字段的最大值
+    long rows;              // 本段抽取的记录数
+    bool bret;              // 本段是否抽取成功
+    int iseq;               // 输出文件的序号，分页抽取时各页的文件连续编号，避免同一秒生成的文件重名
+};
+atomic<int> progress(0);  // 并行抽取时已生成的文件数，主线程据此更新心跳
+
 bool readincfield();    // 读取递增字段最大值。
+bool readincfield(connection& conn1);   // 从数据库表中读取递增字段最大值
 bool _dminingoracle();  // 数据抽取的主函数
+bool mining(st_part& part);         // 抽取一段记录，生成xml文件
+void uptatime(const st_part& part); // 生成了文件，更新心跳
 bool writeincfield();   // 将最大值写入数据库表或文件中
+bool writeincfield(connection& conn1);  // 将最大值写入数据库表中
 
 bool instarttime();     // 用于判断程序是否处于运行时间
 void EXIT(int sig);     // 退出函数
@@ -131,25 +156,18 @@ bool readincfield()
     // 优先查询数据库
     if (strlen(starg.connstr1) > 0)
     {
-        // 连接存放最大值的数据库
-        connection conn1;
-        if (conn1.connecttodb(starg.connstr1, starg.charset) != 0)
+        // 从连接池中取出存放最大值的数据库的连接，池中只有一个连接，第一次取出时登录数据库
+        if (incpool.init(starg.connstr1, starg.charset, 1) == false) return false;
+        connection* conn1 = incpool.get();
+        if (conn1 == nullptr)
         {
-            logfile.write("[readincfield: connect to database failed] conn1.connecttodb(%s, %s)\n", 
-                starg.connstr1, starg.charset);
+            logfile.write("[readincfield: connect to database failed] incpool.get(%s, %s)\n%s\n", 
+                starg.connstr1, starg.charset, incpool.message().c_str());
             return false;
         }
 
-        // 准备查询语句
-        // 表名固定为T_MAXINCVALUE，字段固定为pname和maxincvalue
-        // sql语句固定为：select maxincvalue from T_MAXINCVALUE where pname=:1
-        sqlstatement stmtsel(&conn1);
-        stmtsel.prepare("select maxincvalue from T_MAXINCVALUE where pname=:1");
-        stmtsel.bindin(1, starg.pname);
-        stmtsel.bindout(1, maxincvalue);
-        // 如果执行失败，maxincvalue为0
-        stmtsel.execute();
-        stmtsel.next();
+        readincfield(*conn1);
+        incpool.free(conn1);
     }
     else if (strlen(starg.incfilename) > 0)
     {
@@ -157,9 +175,10 @@ bool readincfield()
         // 如果打开文件失败，可能是没有文件或文件丢失，maxincvalue为0
         if (ifile.open(starg.incfilename) == false) return true;
 
-        string temp;
-        ifile.readline(temp);
-        maxincvalue = stoi(temp);
+        // 以前的版本写入最大值时没有换行符，readline()读不到，直接读取文件的内容
+        char temp[32] = { 0 };
+        ifile.read(temp, sizeof(temp) - 1);
+        maxincvalue = atol(temp);
     }
     else return false; // 如果两个参数都没有
 
@@ -168,19 +187,183 @@ bool readincfield()
     return true;
 }
 
-bool _dminingoracle()
+bool readincfield(connection& conn1)
 {
     // 准备查询语句
-    sqlstatement stmtsel(&conn);
-    stmtsel.prepare(starg.selectsql);
+    // 表名固定为T_MAXINCVALUE，字段固定为pname和maxincvalue
+    // sql语句固定为：select maxincvalue from T_MAXINCVALUE where pname=:1
+    sqlstatement stmtsel(&conn1);
+    stmtsel.prepare("select maxincvalue from T_MAXINCVALUE where pname=:1");
+    stmtsel.bindin(1, starg.pname);
+    stmtsel.bindout(1, maxincvalue);
+    // 如果执行失败，maxincvalue为0
+    stmtsel.execute();
+    stmtsel.next();
+
+    return true;
+}
+
+bool _dminingoracle()
+{
+    // 分页抽取，每次按递增字段的顺序抽取pagesize条记录，每页生成完文件就保存一次最大值，
+    // 程序中断后从最后一页继续抽取，不必从头开始，结果集也不会长时间打开
+    if ((strlen(starg.incfield) > 0) && (starg.pagesize > 0))
+    {
+        st_part part{ 0, &conn, 0, 0, maxincvalue, 0, false, 1 };
+        while (true)
+        {
+            if (mining(part) == false) return false;
+
+            if (part.rows == 0) break;
+
+            // 保存本页的最大值，下一页从这里开始
+            maxincvalue = part.maxincvalue;
+            if (writeincfield() == false) return false;
+
+            if (part.rows < starg.pagesize) break;   // 最后一页
+        }
+
+        return true;
+    }
+
+    // 不是增量抽取或者没有指定并行抽取，用一条sql语句抽取全部的记录
+    if ((strlen(starg.incfield) == 0) || (starg.parallel <= 1))
+    {
+        st_part part{ 0, &conn, 0, 0, maxincvalue, 0, false, 1 };
+        if (mining(part) == false) return false;
+
+        // 更新最大值
+        maxincvalue = part.maxincvalue;
+        if (part.rows > 0) writeincfield();
+
+        return true;
+    }
+
+    // 查询本次待抽取的记录数和递增字段的范围，sql语句中的%%与selectsql相同，由prepare()处理
+    sqlstatement stmt(&conn);
+    stmt.prepare(sformat("select count(*),nvl(min(%s),0),nvl(max(%s),0) from (%s)",
+        starg.incfield, starg.incfield, starg.selectsql));
+    long lastvalue = maxincvalue;
+    long count = 0, minvalue = 0, maxvalue = 0;
+    stmt.bindin(1, lastvalue);
+    stmt.bindout(1, count);
+    stmt.bindout(2, minvalue);
+    stmt.bindout(3, maxvalue);
+    if (stmt.execute() != 0)
+    {
+        logfile.write("[_dminingoracle: execute select sql failed] sql: %s\nerror: %s\n", 
+            stmt.sql(), stmt.message());
+        return false;
+    }
+    stmt.next();
+
+    if (count == 0) return true;   // 没有新的记录
+
+    // 把(minvalue-1, maxvalue]平均分成parallel段，记录数很少时段数不超过记录数
+    int parts = starg.parallel;
+    if (count < parts) parts = count;
+
+    // 第一段使用conn，其它段的连接从连接池中取出，用完之后归还
+    if ((parts > 1) && (partpool.init(starg.connstr, starg.charset, parts - 1) == false)) return false;
 
-    // 绑定参数
-    string fieldvalue[fieldname.size()]; // 用于存放一条查询记录
+    vector<st_part> vparts(parts);
+    auto freeconns = [&vparts] {
+        for (size_t ii = 1; ii < vparts.size(); ++ii)
+            if (vparts[ii].conn != nullptr) partpool.free(vparts[ii].conn);
+    };
+
+    for (int ii = 0; ii < parts; ++ii)
+    {
+        vparts[ii].id = ii + 1;
+        vparts[ii].lower = minvalue - 1 + (maxvalue - minvalue + 1) * ii / parts;
+        vparts[ii].upper = minvalue - 1 + (maxvalue - minvalue + 1) * (ii + 1) / parts;
+        vparts[ii].maxincvalue = maxincvalue;
+        vparts[ii].rows = 0;
+        vparts[ii].bret = false;
+        vparts[ii].iseq = 1;
+
+        if (ii == 0) { vparts[ii].conn = &conn; continue; }
+
+        if ((vparts[ii].conn = partpool.get()) == nullptr)
+        {
+            logfile.write("[_dminingoracle: connect to database failed] partpool.get(%s, %s)\n%s\n",
+                starg.connstr, starg.charset, partpool.message().c_str());
+            freeconns();
+            return false;
+        }
+    }
+
+    // 每段一个线程
+    atomic<int> done(0);
+    vector<thread> vthreads;
+    for (auto& part : vparts)
+        vthreads.emplace_back([&part, &done] { mining(part); ++done; });
+
+    // 等待全部的线程结束，有文件生成才更新心跳，与串行抽取相同
+    int lastprogress = 0;
+    while (done < parts)
+    {
+        this_thread::sleep_for(chrono::milliseconds(100));
+        if (progress != lastprogress) { lastprogress = progress; pactive.uptatime(); }
+    }
+    for (auto& th : vthreads) th.join();
+
+    freeconns();
+
+    // 全部的段都抽取成功，才能更新最大值，否则失败的段的记录会丢失
+    long rows = 0;
+    for (auto& part : vparts)
+    {
+        logfile.write("[part %d] %s>%ld and %s<=%ld, rows: %ld%s\n", part.id, starg.incfield, part.lower,
+            starg.incfield, part.upper, part.rows, part.bret ? "" : ", failed");
+        if (part.bret == false) return false;
+
+        if (maxincvalue < part.maxincvalue) maxincvalue = part.maxincvalue;
+        rows += part.rows;
+    }
+
+    // 更新最大值
+    if (rows > 0) writeincfield();
+
+    return true;
+}
+
+bool mining(st_part& part)
+{
+    // 准备查询语句，并行抽取时在selectsql外面加上本段的范围
+    // 分页抽取时按递增字段排序，只取前pagesize条记录，用rownum而不是fetch first，兼容Oracle 11g
+    sqlstatement stmtsel(part.conn);
+    if (part.id > 0)
+        stmtsel.prepare(sformat("select * from (%s) where %s>:2 and %s<=:3", starg.selectsql, starg.incfield, starg.incfield));
+    else if ((strlen(starg.incfield) > 0) && (starg.pagesize > 0))
+        stmtsel.prepare(sformat("select * from (select * from (%s) order by %s) where rownum<=%d", 
+            starg.selectsql, starg.incfield, starg.pagesize));
+    else
+        stmtsel.prepare(starg.selectsql);
+
+    // 一次从结果集中获取starg.fetchsize条记录，减少与数据库的网络往返。
+    stmtsel.setprefetch(starg.fetchsize);
+
+    // 绑定参数，每个字段用一个数组存放starg.fetchsize条记录的值
+    vector<string> vfieldname(fieldname.size());                  // 每个字段的名称，二进制格式的文件头用
+    vector<int> vfieldlen(fieldname.size());                      // 每个字段的长度
+    vector<vector<char>> fieldvalue(fieldname.size());            // 每个字段的值的数组
     for (int i = 0; i < fieldname.size(); ++i)
-        stmtsel.bindout(i + 1, fieldvalue[i], stoi(fieldlen[i]));
+    {
+        vfieldname[i] = fieldname[i];
+        vfieldlen[i] = stoi(fieldlen[i]);
+        fieldvalue[i].resize(starg.fetchsize * (vfieldlen[i] + 1));
+        stmtsel.bindoutarray(i + 1, &fieldvalue[i][0], vfieldlen[i], starg.fetchsize);
+    }
 
     // 如果是递增查询，还需要绑定where条件中递增字段对应的值
-    if  (strlen(starg.incfield) > 0) stmtsel.bindin(1, maxincvalue);
+    long lastvalue = maxincvalue;
+    if  (strlen(starg.incfield) > 0) stmtsel.bindin(1, lastvalue);
+    if (part.id > 0)
+    {
+        stmtsel.bindin(2, part.lower);
+        stmtsel.bindin(3, part.upper);
+    }
 
     // 执行sql语句
     if (stmtsel.execute() != 0)
@@ -190,58 +373,93 @@ bool _dminingoracle()
         return false;
     }
 
-    pactive.uptatime();
+    uptatime(part);
 
     // sql查询只执行一次，得到所有记录；将记录写入文件分多次，每个文件最多记录maxcount条
     cofile ofile;
-    string xmlfile; // 输出的xml文件名，例如：ZHOBTCODE_20240519162835_togxpt_1.xml
-    int iseq = 1;   // 输出xml文件的序号
-
-    while (stmtsel.next() == 0)
+    cxmlwriter writer;      // 记录先写入缓冲区，缓冲区满了再一次写入文件
+    writer.attach(ofile);
+    cbinwriter bwriter;     // 二进制格式的文件用bwriter，没有用到的writer或bwriter，flush()什么也不做
+    bool bbinary = (strcmp(starg.format, "xml") != 0);
+    const char* suffix = bbinary ? "bin" : "xml";
+    string xmlfile; // 输出的xml文件名，例如：ZHOBTCODE_20240519162835_togxpt_1.xml，并行抽取时为ZHOBTCODE_20240519162835_togxpt_2_1.xml
+    int ret;
+
+    while ((ret = stmtsel.nextarray(starg.fetchsize)) == 0)
     {
-        if (ofile.isopen() == false) // 如果文件未打开
+        for (unsigned int row = 0; row < stmtsel.fetched(); ++row)
         {
-            sformat(xmlfile, "%s/%s_%s_%s_%d.xml", 
-                starg.outpath, starg.bfilename, ltime1("yyyymmddhh24miss", 0).c_str(), starg.efilename, iseq++);
-            if (ofile.open(xmlfile) == false)
+            if (ofile.isopen() == false) // 如果文件未打开
             {
-                logfile.write("[_dminingoracle: open file failed] ofile.open(%s)\n", xmlfile.c_str());
-                return false;
+                if (part.id == 0)
+                    sformat(xmlfile, "%s/%s_%s_%s_%d.%s", 
+                        starg.outpath, starg.bfilename, ltime1("yyyymmddhh24miss", 0).c_str(), starg.efilename, part.iseq++, suffix);
+                else
+                    sformat(xmlfile, "%s/%s_%s_%s_%d_%d.%s", 
+                        starg.outpath, starg.bfilename, ltime1("yyyymmddhh24miss", 0).c_str(), starg.efilename, part.id, part.iseq++, suffix);
+                if (ofile.open(xmlfile) == false)
+                {
+                    logfile.write("[_dminingoracle: open file failed] ofile.open(%s)\n", xmlfile.c_str());
+                    return false;
+                }
+
+                // 写入数据集开始的标志，二进制格式是文件头
+                if (bbinary == true)
+                    bwriter.start(ofile, vfieldname, vfieldlen, strcmp(starg.format, "binz") == 0);
+                else
+                    writer.addstr("<data>\n");
             }
 
-            ofile.writeline("<data>\n"); // 写入数据集开始的标志
-        }
-
-        // 将结果集写入文件中
-        for (int i = 0; i <fieldname.size(); ++i)
-            ofile.writeline("<%s>%s</%s>", 
-                fieldname[i].c_str(), fieldvalue[i].c_str(), fieldname[i].c_str());
-        ofile.writeline("<endl/>\n"); // 写入每行结束标志
-
-        // 如果记录数达到starg.maxcount行就关闭当前文件
-        if ((starg.maxcount > 0) && (stmtsel.rpc() % starg.maxcount == 0))
-        {
-            ofile.writeline("</data>\n"); // 写入文件的结束标志
-            if (ofile.closeandrename() == false)
+            // 将结果集写入文件中，第row条记录的值在数组中的位置是row*(字段长度+1)
+            for (int i = 0; i <fieldname.size(); ++i)
+            {
+                const char* value = &fieldvalue[i][row * (vfieldlen[i] + 1)];
+                if (bbinary == true)
+                    bwriter.addfield(value, strlen(value));
+                else
+                    writer.addfield(fieldname[i], value);
+            }
+            if ((bbinary ? bwriter.endrecord() : writer.endrecord()) == false) // 写入每行结束标志
             {
-                logfile.write("[_dminingoracle: close and rename file failed] ofile.closeandrename()\n");
+                logfile.write("[_dminingoracle: write file failed] %s\n", xmlfile.c_str());
                 return false;
             }
-            logfile.write("[generate file %s(%d)]\n", xmlfile.c_str(), starg.maxcount);
 
-            pactive.uptatime();
+            // 如果记录数达到starg.maxcount行就关闭当前文件
+            if ((starg.maxcount > 0) && ((stmtsel.rpc() - stmtsel.fetched() + row + 1) % starg.maxcount == 0))
+            {
+                if (bbinary == false) writer.addstr("</data>\n"); // 写入文件的结束标志
+                if ((writer.flush() == false) || (bwriter.flush() == false) || (ofile.closeandrename() == false))
+                {
+                    logfile.write("[_dminingoracle: close and rename file failed] ofile.closeandrename()\n");
+                    return false;
+                }
+                logfile.write("[generate file %s(%d)]\n", xmlfile.c_str(), starg.maxcount);
+
+                uptatime(part);
+            }
+
+            // 更新递增字段最大值
+            if (strlen(starg.incfield) > 0)
+            {
+                long incvalue = atol(&fieldvalue[incfieldpos][row * (vfieldlen[incfieldpos] + 1)]);
+                if (part.maxincvalue < incvalue) part.maxincvalue = incvalue;
+            }
         }
+    }
 
-        // 更新递增字段最大值
-        if ((strlen(starg.incfield) > 0) && (maxincvalue < stoi(fieldvalue[incfieldpos])))
-            maxincvalue = stoi(fieldvalue[incfieldpos]);
+    // 获取结果集的过程中出现了错误。
+    if (ret != 1403)
+    {
+        logfile.write("[_dminingoracle: fetch failed] sql: %s\nerror: %s\n", stmtsel.sql(), stmtsel.message());
+        return false;
     }
 
     // 如果maxcount==0或者向xml文件中写入的记录数不足maxcount，关闭文件
-    if ((starg.maxcount == 0) || (stmtsel.rpc() % starg.maxcount > 0))
+    if ((ofile.isopen() == true) && ((starg.maxcount == 0) || (stmtsel.rpc() % starg.maxcount > 0)))
     {
-        ofile.writeline("</data>\n"); // 写入文件的结束标志
-        if (ofile.closeandrename() == false)
+        if (bbinary == false) writer.addstr("</data>\n"); // 写入文件的结束标志
+        if ((writer.flush() == false) || (bwriter.flush() == false) || (ofile.closeandrename() == false))
         {
             logfile.write("[_dminingoracle: close and rename file failed] ofile.closeandrename()\n");
             return false;
@@ -252,74 +470,96 @@ bool _dminingoracle()
         else
             logfile.write("[generate file %s(%d)]\n", xmlfile.c_str(), stmtsel.rpc() % starg.maxcount);
 
-        pactive.uptatime();    
+        uptatime(part);
     }
 
-    // 更新最大值
-    if (stmtsel.rpc() > 0) writeincfield();
-    
+    part.rows = stmtsel.rpc();
+    part.bret = true;
+
     return true;
 }
 
+void uptatime(const st_part& part)
+{
+    if (part.id == 0) pactive.uptatime();
+    else ++progress;
+}
+
 bool writeincfield()
 {
     if (strlen(starg.incfield) == 0) return true;
 
     if (strlen(starg.connstr1) > 0)
     {
-        connection conn1;
-        if (conn1.connecttodb(starg.connstr1, starg.charset) != 0)
+        // 连接池在readincfield()中已初始化，连接失效时get()会重新登录
+        connection* conn1 = incpool.get();
+        if (conn1 == nullptr)
         {
-            logfile.write("[readincfield: connect to database failed] conn1.connecttodb(%s, %s)\n", 
-                starg.connstr1, starg.charset);
+            logfile.write("[writeincfield: connect to database failed] incpool.get(%s, %s)\n%s\n", 
+                starg.connstr1, starg.charset, incpool.message().c_str());
             return false;
         }
 
-        sqlstatement stmtupt(&conn1);
-        stmtupt.prepare("update T_MAXINCVALUE set maxincvalue=:1 where pname=:2");
-        stmtupt.bindin(1, maxincvalue);
-        stmtupt.bindin(2, starg.pname);
-        if (stmtupt.execute() != 0) // 执行失败
-        {
-            if (stmtupt.rc() == 942) // 如果表不存在，stmt.execute()将返回ORA-00942的错误
-            {
-                // 如果表不存在，就创建表，然后插入记录
-                conn1.execute("create table T_MAXINCVALUE(pname varchar2(64),maxincvalue) number(15),primary key(pname)");
-                conn1.execute("insert into T_MAXINCVALUE(pname,maxincvalue) values('%s',%ld)", starg.pname, maxincvalue);
-                conn1.commit();
-                return true;
-            }
-            else
-            {
-                logfile.write("[writeincfield: execute update sql failed] sql: %s\nerror: %s\n", 
-                    stmtupt.sql(), stmtupt.message());
-            }
-        }
-        else // 执行成功
-        {
-            if (stmtupt.rpc() == 0) // 如果更新的记录不存在，就插入记录
-                conn1.execute("insert into T_MAXINCVALUE(pname,maxincvalue) values('%s',%ld)", starg.pname, maxincvalue);
+        bool ret = writeincfield(*conn1);
+        incpool.free(conn1);
 
-            conn1.commit();
-            return true;
-        }
+        return ret;
     }
     else if (strlen(starg.incfilename) > 0)
     {
+        // 采用临时文件的方案，写完再改名，程序在写文件的时候中断，也不会留下不完整的最大值
         cofile ofile;
-        if (ofile.open(starg.incfilename, false) == false) // cofile::open()函数支持自动创建文件
+        if (ofile.open(starg.incfilename) == false) // cofile::open()函数支持自动创建文件
         {
             logfile.write("[writeincfield: open file failed] ofile.open(%s)\n", starg.incfilename);
             return false;
         }
 
-        ofile.writeline("%ld", maxincvalue); // 默认覆盖写
+        ofile.writeline("%ld\n", maxincvalue); // 默认覆盖写
+        if (ofile.closeandrename() == false)
+        {
+            logfile.write("[writeincfield: close and rename file failed] ofile.closeandrename(%s)\n", starg.incfilename);
+            return false;
+        }
     }
     else return false;
 
     return true;  
 }
 
+bool writeincfield(connection& conn1)
+{
+    sqlstatement stmtupt(&conn1);
+    stmtupt.prepare("update T_MAXINCVALUE set maxincvalue=:1 where pname=:2");
+    stmtupt.bindin(1, maxincvalue);
+    stmtupt.bindin(2, starg.pname);
+    if (stmtupt.execute() != 0) // 执行失败
+    {
+        if (stmtupt.rc() == 942) // 如果表不存在，stmt.execute()将返回ORA-00942的错误
+        {
+            // 如果表不存在，就创建表，然后插入记录
+            conn1.execute("create table T_MAXINCVALUE(pname varchar2(64),maxincvalue number(15),primary key(pname))");
+            conn1.execute("insert into T_MAXINCVALUE(pname,maxincvalue) values('%s',%ld)", starg.pname, maxincvalue);
+            conn1.commit();
+            return true;
+        }
+        else
+        {
+            logfile.write("[writeincfield: execute update sql failed] sql: %s\nerror: %s\n", 
+                stmtupt.sql(), stmtupt.message());
+            return false;
+        }
+    }
+    else // 执行成功
+    {
+        if (stmtupt.rpc() == 0) // 如果更新的记录不存在，就插入记录
+            conn1.execute("insert into T_MAXINCVALUE(pname,maxincvalue) values('%s',%ld)", starg.pname, maxincvalue);
+
+        conn1.commit();
+        return true;
+    }
+}
+
 bool instarttime()
 {
     if (strlen(starg.starttime) > 0)
@@ -382,7 +622,16 @@ void _help()
     "incfilename 已抽取数据的递增字段最大值存放的文件，如果该文件丢失，将重新抽取全部的数据\n"
     "connstr1    已抽取数据的递增字段最大值存放的数据库的连接参数。connstr1和incfilename二选一，connstr1优先\n"
     "timeout     本程序的超时时间，单位：秒\n"
-    "pname       进程名，尽可能采用易懂的、与其它进程不同的名称，方便故障排查\n\n";
+    "pname       进程名，尽可能采用易懂的、与其它进程不同的名称，方便故障排查\n"
+    "fetchsize   每次从结果集中获取的记录数，可选参数，取值在1-5000之间，缺省是1000\n"
+    "parallel    并行抽取的线程数，可选参数，取值在1-16之间，缺省是1，只用于增量抽取，把递增字段的范围平均分成parallel段，\n"
+    "            每段用一个线程和一个数据库连接同时抽取，生成各自的xml文件，文件名在efilename后面加上段的编号，\n"
+    "            例如ZHOBTMIND_20240519162835_togxpt_2_1.xml，全部的段都抽取成功之后才更新递增字段的最大值\n"
+    "pagesize    分页抽取时每页的记录数，可选参数，缺省是0，表示不分页，只用于增量抽取，不能与parallel同时使用，\n"
+    "            按递增字段的顺序每次抽取pagesize条记录，每页的文件生成之后就保存递增字段的最大值，\n"
+    "            程序中断后从最后一页继续抽取，递增字段的值必须唯一，否则页边界上的记录可能会漏掉\n"
+    "format      输出文件的格式，可选参数，xml-xml格式（缺省）；bin-二进制格式，文件名的后缀为.bin，比xml格式小很多，\n"
+    "            不需要解析标签；binz-二进制格式，数据块用zlib压缩，适合通过网络传输，xmltodb可以直接入库这两种格式的文件\n\n";
 }   
 
 bool _xmltoarg(const string& xmlbuffer)
@@ -429,6 +678,28 @@ bool _xmltoarg(const string& xmlbuffer)
     getxmlbuffer(xmlbuffer, "pname", starg.pname, 63);     
     if (strlen(starg.pname)==0) { logfile.write("pname is null.\n");  return false; }
 
+    getxmlbuffer(xmlbuffer, "fetchsize", starg.fetchsize);
+    if (starg.fetchsize < 1) starg.fetchsize = 1000;
+    if (starg.fetchsize > 5000) starg.fetchsize = 5000;
+
+    getxmlbuffer(xmlbuffer, "parallel", starg.parallel);
+    if (starg.parallel < 1)  starg.parallel = 1;
+    if (starg.parallel > 16) starg.parallel = 16;
+
+    getxmlbuffer(xmlbuffer, "pagesize", starg.pagesize);
+    if (starg.pagesize < 0) starg.pagesize = 0;
+    if ((starg.pagesize > 0) && (starg.parallel > 1))
+    {
+        logfile.write("pagesize和parallel不能同时使用\n"); return false;
+    }
+
+    getxmlbuffer(xmlbuffer, "format", starg.format, 10);
+    if (strlen(starg.format) == 0) strcpy(starg.format, "xml");
+    if ((strcmp(starg.format, "xml") != 0) && (strcmp(starg.format, "bin") != 0) && (strcmp(starg.format, "binz") != 0))
+    {
+        logfile.write("format must be xml, bin or binz.\n"); return false;
+    }
+
     // 拆分starg.fieldstr到fieldname中。
     fieldname.splittocmd(starg.fieldstr, ",");
 
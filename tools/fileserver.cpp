@@ -16,6 +16,14 @@
           将再下次发送文件时将上传发送失败的文件重传
           如果发送端断开连接，接收端发送确保报文时会失败，届时再退出
           发送端删除或备份文件失败时，写日志但不退出
+
+    运行模式：
+    1.多进程模式（缺省）：每接受一个客户端的连接，就fork一个子进程为它服务
+    2.事件驱动模式：启动时指定了工作进程数，每个工作进程用epoll管理多个客户端的连接，
+      socket是非阻塞的，每个连接用状态机处理登录、心跳、文件信息、文件内容和确认报文，
+      适用于客户端很多的场景
+      事件驱动模式不支持断点续传、压缩传输和二进制格式的报文，登录时会通知客户端关闭这些功能，
+      大文件中断后从头重传，需要这些功能的客户端应该连接多进程模式的服务端
 */
 
 #include "_public.h"
@@ -35,37 +43,62 @@ struct st_arg
     int timetvl;
     int timeout;
     char pname[64];
+    int streams;        // 客户端下载文件的连接数
+    int streamid;       // 本连接的编号，从0开始
+    bool resume;        // 客户端是否支持大文件的断点续传
+    bool compress;      // 客户端是否要求压缩传输文件的内容（zlib）
+    int protover;       // 与客户端协商的协议版本，1-xml格式的报文，2-二进制格式的报文
 }starg;
 
+const long RESUMESIZE = 10485760;   // 大于等于10M的文件，发送前与对端协商断点续传的位置
+const int ACKTIMEOUT = 30;          // 等待确认报文的超时时间，单位：秒，超时认为连接已不可用
+
 clogfile logfile;       // 日志
 cpactive pactive;       // 进程心跳
 ctcpserver tcpserver;   // tcp客户端
 
 string sendbuffer;      // 发送报文
 string recvbuffer;      // 接收报文
+unsigned int seq = 0;   // 文件信息报文的序号
 
 bool clientlogin();     // 处理登录客户端的登录报文
 bool activetest();      // 发送心跳报文的函数
 
 void sendfilesmain();   // 发送文件的主函数
 bool _sendfiles(bool& bcontinue); // 执行一次发送任务的函数，bcontinue表示本次任务是否发送了文件
-bool sendfile(const string& filename, const int filesize); // 发送一个文件的函数，文件名用绝对路径
-bool ackmessage(const string& recvbuffer); // 处理确认报文
+bool sendfile(const string& filename, const long filesize, const long offset, 
+              const bool bcompress); // 发送一个文件的函数，文件名用绝对路径，bcompress为是否压缩传输
+bool recvack(csendwindow& window, const int itimeout); // 接收并处理一个确认报文，itimeout与ctcpserver::read()相同
+bool ackmessage(const string& recvbuffer, csendwindow& window, const struct st_arg& arg); // 处理确认报文，arg为客户端的登录参数
+bool waitoffset(long& offset, csendwindow& window); // 等待对端断点续传的回应，期间收到的确认报文照常处理
 
 void recvfilesmain();   // 接收文件的主函数
-bool recvfile(const string& filename, const string& mtime, const int filesize); // 执行一次接收任务的函数，文件名用绝对路径
+bool recvfile(const string& filename, const string& mtime, const long filesize, 
+              const long offset, const bool bresume, const bool bcompress); // 执行一次接收任务的函数，文件名用绝对路径，offset为断点续传的位置
+
+void parselogin(const string& buffer, struct st_arg& arg); // 解析客户端的登录报文
+string loginreply(const struct st_arg& arg, const bool bresume); // 登录成功的回应报文，告诉客户端服务端支持的功能
+bool mystream(const string& filename, const struct st_arg& arg); // 判断文件是否分配给本连接
+
+void epollmain(const int workers);  // 事件驱动模式的主函数，workers为工作进程数
+void epollworker();                 // 工作进程的主函数
 
 void FathEXIT(int sig); // 父进程退出函数
 void ChldEXIT(int sig); // 子进程退出函数
 
 int main(int argc, char* argv[])
 {
-    if (argc != 3)
+    if ((argc != 3) && (argc != 4))
     {
         cout << "\n\n"
-        "Using:fileserver logfilename port\n"
+        "Using:fileserver logfilename port [workers]\n"
         "Example:\n"
-        "/MDC/bin/tools/procctl 10 /MDC/bin/tools/fileserver /MDC/log/tools/fileserver.log 5005\n\n";
+        "/MDC/bin/tools/procctl 10 /MDC/bin/tools/fileserver /MDC/log/tools/fileserver.log 5005\n"
+        "/MDC/bin/tools/procctl 10 /MDC/bin/tools/fileserver /MDC/log/tools/fileserver.log 5005 4\n\n"
+        "workers 工作进程数，可选参数，如果不指定，每个客户端的连接由一个子进程服务；\n"
+        "        如果指定，采用事件驱动（epoll）模式，由workers个工作进程服务全部的客户端连接。\n"
+        "        事件驱动模式不支持断点续传、压缩传输和二进制格式的报文，客户端即使请求了这些功能也不会启用，\n"
+        "        大文件中断后从头重传。\n\n";
 
         return -1;
     }
@@ -82,16 +115,24 @@ int main(int argc, char* argv[])
         return -1;
     }
 
-    // 配置心跳信息
-    pactive.addpinfo(starg.timeout, starg.pname);
-
-    // 初始化监听端口
-    if (tcpserver.initserver(atoi(argv[2])) == false)
+    // 初始化监听端口，事件驱动模式的连接很多，已连接队列要大一些
+    if (tcpserver.initserver(atoi(argv[2]), argc == 4 ? SOMAXCONN : 5) == false)
     {
         logfile.write("[init listen port failed] tcpserver.initserver(%d)\n", atoi(argv[2]));
         return -1;
     }
 
+    // 事件驱动模式由每个工作进程登记自己的心跳信息，父进程不能登记，
+    // 否则fork出来的工作进程会继承父进程在共享内存中的位置，全部的工作进程共用一条心跳记录
+    if (argc == 4)
+    {
+        epollmain(atoi(argv[3]));
+        return 0;
+    }
+
+    // 配置心跳信息
+    pactive.addpinfo(starg.timeout, starg.pname);
+
     while (true)
     {
         if (tcpserver.accept() == false)
@@ -131,8 +172,6 @@ int main(int argc, char* argv[])
 
 bool clientlogin()
 {
-    memset(&starg, 0, sizeof(struct st_arg));
-
     //[Debug] logfile.write("[clientlogin] recv ... ");
     if (tcpserver.read(recvbuffer) == false)
     {
@@ -142,23 +181,13 @@ bool clientlogin()
     }
     //[Debug] logfile << "success\n";
 
-    // 不需要对参数做合法性检验，因为客户端已经做过了
-    getxmlbuffer(recvbuffer, "clienttype", starg.clienttype);
-    getxmlbuffer(recvbuffer, "ptype", starg.ptype);
-    getxmlbuffer(recvbuffer, "srvpath", starg.srvpath, 255);
-    getxmlbuffer(recvbuffer, "srvpathbak", starg.srvpathbak, 255);
-    getxmlbuffer(recvbuffer, "andchild", starg.andchild);
-    getxmlbuffer(recvbuffer, "matchname", starg.matchname, 255);
-    getxmlbuffer(recvbuffer, "clientpath", starg.clientpath, 255);
-    getxmlbuffer(recvbuffer, "timetvl", starg.timetvl);
-    getxmlbuffer(recvbuffer, "timeout", starg.timeout);
-    getxmlbuffer(recvbuffer, "pname", starg.pname, 63);
+    parselogin(recvbuffer, starg);
 
     // 判断客户端类型是否合法
     if ((starg.clienttype != 1) && (starg.clienttype != 2))
         sendbuffer = "failed";
     else
-        sendbuffer = "success";
+        sendbuffer = loginreply(starg, true);
 
     // 发送报文
     if (tcpserver.write(sendbuffer) == false)
@@ -178,15 +207,74 @@ bool clientlogin()
 }
 
 //在没有文件可发时向对端发送心跳报文，以保持tcp连接
+void parselogin(const string& buffer, struct st_arg& arg)
+{
+    memset(&arg, 0, sizeof(struct st_arg));
+
+    // 不需要对参数做合法性检验，因为客户端已经做过了
+    getxmlbuffer(buffer, "clienttype", arg.clienttype);
+    getxmlbuffer(buffer, "ptype", arg.ptype);
+    getxmlbuffer(buffer, "srvpath", arg.srvpath, 255);
+    getxmlbuffer(buffer, "srvpathbak", arg.srvpathbak, 255);
+    getxmlbuffer(buffer, "andchild", arg.andchild);
+    getxmlbuffer(buffer, "matchname", arg.matchname, 255);
+    getxmlbuffer(buffer, "clientpath", arg.clientpath, 255);
+    getxmlbuffer(buffer, "timetvl", arg.timetvl);
+    getxmlbuffer(buffer, "timeout", arg.timeout);
+    getxmlbuffer(buffer, "pname", arg.pname, 63);
+    getxmlbuffer(buffer, "streams", arg.streams);
+    getxmlbuffer(buffer, "streamid", arg.streamid);
+    getxmlbuffer(buffer, "resume", arg.resume);
+
+    // 目前只支持zlib压缩，其它的压缩算法当作不压缩处理
+    string compress;
+    getxmlbuffer(buffer, "compress", compress);
+    arg.compress = (compress == "zlib");
+
+    // 旧版本的客户端不发送<protover>，用xml格式的报文，新版本的客户端不能高于服务端支持的版本
+    getxmlbuffer(buffer, "protover", arg.protover);
+    if (arg.protover < 1) arg.protover = 1;
+    if (arg.protover > PROTOVER) arg.protover = PROTOVER;
+}
+
+string loginreply(const struct st_arg& arg, const bool bresume)
+{
+    string reply = "success";
+
+    // 客户端上传文件，告诉客户端服务端支持大文件的断点续传
+    if ((arg.clienttype == 2) && (bresume == true)) reply.append("<resume>true</resume>");
+
+    // 客户端用多个连接下载文件，服务端按文件名把文件分配到各连接上
+    if ((arg.clienttype == 1) && (arg.streams > 1)) reply.append(sformat("<streams>%d</streams>", arg.streams));
+
+    // 告诉客户端服务端同意压缩传输，客户端没有收到这个标签就不压缩
+    if (arg.compress == true) reply.append("<compress>zlib</compress>");
+
+    // 告诉客户端登录之后的报文采用的协议版本，客户端没有收到这个标签就用xml格式
+    if (arg.protover > 1) reply.append(sformat("<protover>%d</protover>", arg.protover));
+
+    return reply;
+}
+
+bool mystream(const string& filename, const struct st_arg& arg)
+{
+    if (arg.streams <= 1) return true;
+
+    // 同一个文件名的哈希值是确定的，各连接的文件不会重复，也不会遗漏
+    return hash<string>()(filename) % arg.streams == (size_t)arg.streamid;
+}
+
 bool activetest()
 {
-    sendbuffer = "<activetest>ok</activetest>";
+    st_filemsg msg;
+    msg.type = FMSG_ACTIVETEST;
+    packfilemsg(msg, sendbuffer, starg.protover);
 
-    //[Debug] logfile.write("[activetest] send %s ... ", sendbuffer.c_str());
+    //[Debug] logfile.write("[activetest] send ... ");
     if (tcpserver.write(sendbuffer) == false)
     {
         //[Debug] logfile << "failed\n";
-        logfile.write("[activetest: send buffer failed] tcpserver.write(%s)\n", sendbuffer.c_str());
+        logfile.write("[activetest: send buffer failed] tcpserver.write()\n");
         return false;
     }
     //[Debug] logfile << "success\n";
@@ -208,6 +296,11 @@ void sendfilesmain()
 {
     bool bcontinue = true;
 
+    // 监视服务端的目录，有新文件时立即发送，没有新文件时不必扫描目录
+    cdirwatch watcher;
+    if (watcher.watch(starg.srvpath, starg.matchname, starg.andchild) == false)
+        logfile.write("[sendfilesmain: watch directory failed] watcher.watch(%s), scan every %d seconds\n", starg.srvpath, starg.timetvl);
+
     while (true)
     {
         if (_sendfiles(bcontinue) == false) 
@@ -216,11 +309,16 @@ void sendfilesmain()
             return;
         }
 
-        if (bcontinue == false) // 如果未发送文件，就休眠，并发送心跳报文
+        // 如果未发送文件，就等待目录中的新文件，每次等待后发送心跳报文
+        while (bcontinue == false)
         {
-            sleep(starg.timetvl);
+            bool bchanged = watcher.wait(starg.timetvl);
 
             if (activetest() == false) return;
+
+            pactive.uptatime();
+
+            if (bchanged == true) break;
         }
 
         pactive.uptatime();
@@ -238,113 +336,163 @@ bool _sendfiles(bool& bcontinue)
         return false;
     }
 
-    int delayed = 0; // 未收到对端确认报文的文件数量
+    csendwindow window; // 已发送但未收到对端确认报文的文件
 
     // 同步方式：一问一答，发送文件后等待对方的确认报文，收到确认报文后再发送下一个文件
     // 异步方式：问答分离，发送文件后查看接收缓冲区，如果有确认报文就处理，没有就继续发送文件
     // 在文件发送完后，继续处理剩余的确认报文
-    // 异步的方式效率远高于同步，这里采用异步方式
+    // 异步的方式效率远高于同步，这里采用异步方式，并用发送窗口限制未确认的文件数和字节数
     while (dir.readdir())
     {
+        // 客户端用多个连接下载文件时，只发送分配给本连接的文件
+        if (mystream(dir.m_filename, starg) == false) continue;
+
         bcontinue = true;
 
+        // 发送窗口已满，等待确认报文
+        while (window.full() == true)
+        {
+            if (recvack(window, ACKTIMEOUT) == false) return false;
+        }
+
+        // 客户端支持断点续传时，大文件要先协商从哪个位置开始发送
+        bool bresume = (starg.resume == true) && (dir.m_filesize >= RESUMESIZE);
+
+        // 已经是压缩格式的文件再压缩也小不了多少，直接发送
+        bool bcompress = (starg.compress == true) && (compressible(dir.m_filename) == true);
+
         // 先向对端发送文件信息
-        sformat(sendbuffer, "<filename>%s</filename><filesize>%d</filesize><mtime>%s</mtime>", 
-            dir.m_filename.c_str(), dir.m_filesize, dir.m_mtime.c_str());
+        st_filemsg msg;
+        msg.type = FMSG_FILEHEAD;
+        msg.flags = (bresume ? FMSG_RESUME : 0) | (bcompress ? FMSG_COMPRESS : 0);
+        msg.seq = ++seq;
+        msg.filename = dir.m_filename;
+        msg.filesize = dir.m_filesize;
+        msg.mtime = dir.m_mtime;
+        if (packfilemsg(msg, sendbuffer, starg.protover) == false)
+        {
+            logfile.write("[_sendfiles: pack message failed] packfilemsg(%s)\n", dir.m_filename.c_str());
+            return false;
+        }
         
-        //[Debug] logfile.write("[_sendfiles] send %s ... ", sendbuffer.c_str());
+        //[Debug] logfile.write("[_sendfiles] send %s ... ", dir.m_filename.c_str());
         if (tcpserver.write(sendbuffer) == false)
         {
             //[Debug] logfile << "failed\n";
-            logfile.write("[_sendfiles: send buffer failed] tcpserver.write(%s)\n", sendbuffer.c_str());
+            logfile.write("[_sendfiles: send buffer failed] tcpserver.write(%s)\n", dir.m_filename.c_str());
             return false;
         }
         //[Debug] logfile << "success\n";
 
+        // 等待对端回应已接收的字节数
+        long offset = 0;
+        if ((bresume == true) && (waitoffset(offset, window) == false)) return false;
+
         // 再发送文件
-        logfile.write("[_sendfiles] send %s(%d) ... ", dir.m_filename.c_str(), dir.m_filesize);
-        if (sendfile(dir.m_ffilename, dir.m_filesize) == false)
+        logfile.write("[_sendfiles] send %s(%ld) from %ld ... ", dir.m_filename.c_str(), dir.m_filesize, offset);
+        if (sendfile(dir.m_ffilename, dir.m_filesize, offset, bcompress) == false)
         {
             logfile << "failed\n";
             return false; 
         }
         logfile << "success\n";
-        ++delayed;
+        window.push(msg.seq, dir.m_filename, dir.m_filesize);
 
         pactive.uptatime();
 
-        while (delayed > 0)
-        {
-            // 接收对端的确认报文，时间设置为-1，表示不等待，如果接收缓冲区没有报文就继续发送文件
-            if (tcpserver.read(recvbuffer, -1) == false) break;
-            
-            ackmessage(recvbuffer);
-            --delayed;
-        } 
+        // 接收对端的确认报文，时间设置为-1，表示不等待，如果接收缓冲区没有报文就继续发送文件
+        while ((window.empty() == false) && (recvack(window, -1) == true));
     }
 
-    // 接收剩余的确认报文
-    while (delayed > 0)
+    // 接收剩余的确认报文，每个文件都要确认，超时说明连接已不可用，重新连接后未确认的文件会重新发送
+    while (window.empty() == false)
     {
-        if (tcpserver.read(recvbuffer, 10) == false) break;
+        if (recvack(window, ACKTIMEOUT) == false)
+        {
+            logfile.write("[_sendfiles: recv ack failed] %d files not acknowledged\n", (int)window.size());
+            return false;
+        }
 
-        ackmessage(recvbuffer);
-        --delayed;
+        pactive.uptatime();
     }
 
     return true;
 }
 
-// 以二进制的形式发送文件
-bool sendfile(const string& filename, const int filesize)
+bool recvack(csendwindow& window, const int itimeout)
 {
-    int onread = 0;     // 将要读取的字节数
-    int totalbytes = 0; // 已经读取的总字节数
-    char buffer[1024];  // 存放读取的数据
-    cifile ifile;
+    if (tcpserver.read(recvbuffer, itimeout) == false) return false;
 
-    if (ifile.open(filename, ios::in | ios::binary) ==false) return false;
+    ackmessage(recvbuffer, window, starg);
 
-    while (totalbytes < filesize)
-    {
-        memset(buffer, 0, sizeof(buffer));
+    return true;
+}
+
+// 以二进制的形式发送文件
+bool sendfile(const string& filename, const long filesize, const long offset, const bool bcompress)
+{
+    // 压缩传输时，文件的内容边压缩边发送
+    if (bcompress == true) return tcpserver.sendfilez(filename, filesize, offset);
 
-        onread = (filesize - totalbytes) > 1024 ? 1024 : (filesize - totalbytes);
+    // 文件的内容由内核直接拷贝到socket，不经过用户空间的缓冲区
+    return tcpserver.sendfile(filename, filesize, offset);
+}
+
+bool waitoffset(long& offset, csendwindow& window)
+{
+    st_filemsg msg;
 
-        ifile.read(buffer, onread);
+    while (true)
+    {
+        if (tcpserver.read(recvbuffer, 30) == false)
+        {
+            logfile.write("[waitoffset: recv buffer failed] tcpserver.read()\n");
+            return false;
+        }
 
-        if (tcpserver.write(buffer, onread) == false) return false;
+        if ((unpackfilemsg(recvbuffer, msg) == true) && (msg.type == FMSG_OFFSET)) break;
 
-        totalbytes += onread;
+        // 前面发送的文件的确认报文
+        ackmessage(recvbuffer, window, starg);
     }
 
+    offset = msg.offset;
+
     return true;
 }
 
-bool ackmessage(const string& recvbuffer)
+bool ackmessage(const string& recvbuffer, csendwindow& window, const struct st_arg& arg)
 {
-    string filename;
-    string result;
+    // 确认报文可能是xml格式，也可能是二进制格式
+    st_filemsg msg;
+    if ((unpackfilemsg(recvbuffer, msg) == false) || (msg.type != FMSG_ACK)) return false;
 
-    getxmlbuffer(recvbuffer, "filename", filename);
-    getxmlbuffer(recvbuffer, "result", result);
+    // 按序号从发送窗口中取出对应的文件，对应不上的确认报文不处理
+    csendwindow::st_inflight item;
+    if (window.ack(msg, item) == false)
+    {
+        logfile.write("[ackmessage: unexpected ack] seq=%u, filename=%s\n", msg.seq, msg.filename.c_str());
+        return false;
+    }
+
+    if ((msg.flags & FMSG_SUCCESS) == 0) return false;
 
-    if (result != "success") return false;
+    const string& filename = item.filename;
 
     // 如果接收端成功收到文件，则删除或备份发送端文件
-    if (starg.ptype == 1)
+    if (arg.ptype == 1)
     {
-        string removefile = sformat("%s/%s", starg.srvpath, filename.c_str());
+        string removefile = sformat("%s/%s", arg.srvpath, filename.c_str());
         if (remove(removefile.c_str()) != 0)
         {
             logfile.write("[ackmessage: remove file failed] remove(%s)\n", removefile.c_str());
             return false;
         }
     }
-    else if (starg.ptype == 2)
+    else if (arg.ptype == 2)
     {
-        string rscfile = sformat("%s/%s", starg.srvpath, filename.c_str());
-        string dstfile = sformat("%s/%s", starg.srvpathbak, filename.c_str());
+        string rscfile = sformat("%s/%s", arg.srvpath, filename.c_str());
+        string dstfile = sformat("%s/%s", arg.srvpathbak, filename.c_str());
         if (rename(rscfile.c_str(), dstfile.c_str()) != 0)
         {
             logfile.write("[ackmessage: bak file failed] rename(%s, %s)\n", rscfile.c_str(), dstfile.c_str());
@@ -372,51 +520,68 @@ void recvfilesmain()
         }
         //[debug] logfile.write("[recvfilesmain] recv %s\n", recvbuffer.c_str());
 
+        st_filemsg msg;
+        if (unpackfilemsg(recvbuffer, msg) == false) continue;
+
         // 处理心跳报文
-        if (recvbuffer == "<activetest>ok</activetest>")
+        if (msg.type == FMSG_ACTIVETEST)
         {
-            sendbuffer = "ok";
-            //[Debug] logfile.write("[recvfilesmain] send %s ... ", sendbuffer.c_str());
+            msg.type = FMSG_ACTIVEOK;
+            packfilemsg(msg, sendbuffer, starg.protover);
+            //[Debug] logfile.write("[recvfilesmain] send ok ... ");
             if (tcpserver.write(sendbuffer) == false)
             {
                 //[Debug] logfile << "failed\n";
-                logfile.write("[recvfilesmain: send buffer failed] tcpserver.write(%s)\n", sendbuffer.c_str());
+                logfile.write("[recvfilesmain: send buffer failed] tcpserver.write()\n");
                 return;
             }
             //[Debug] logfile << "success\n";
         }
 
         // 处理上传文件的请求报文
-        if (recvbuffer.find("<filename>") != string::npos)
+        if (msg.type == FMSG_FILEHEAD)
         {   
-            string filename;
-            string mtime;
-            int filesize;
-
-            getxmlbuffer(recvbuffer, "filename", filename);
-            getxmlbuffer(recvbuffer, "mtime", mtime);
-            getxmlbuffer(recvbuffer, "filesize", filesize);
-
-            string localfile = sformat("%s/%s", starg.srvpath, filename.c_str());
-            sendbuffer = sformat("<filename>%s</filename>", filename.c_str());
-            logfile.write("[_tcpgetfiles] recv %s(%d) ... ", localfile.c_str(), filesize);
-            if (recvfile(localfile, mtime, filesize) == false)
+            bool bresume = (msg.flags & FMSG_RESUME) != 0;
+            bool bcompress = (msg.flags & FMSG_COMPRESS) != 0;
+
+            string localfile = sformat("%s/%s", starg.srvpath, msg.filename.c_str());
+
+            // 大文件断点续传：告诉客户端临时文件中已接收的字节数，客户端从这个位置开始发送
+            // 回应报文和确认报文沿用文件信息报文的序号和文件名
+            st_filemsg reply = msg;
+            reply.flags = 0;
+            reply.offset = 0;
+            if (bresume == true)
+            {
+                reply.type = FMSG_OFFSET;
+                reply.offset = resumeoffset(localfile + ".tmp", msg.mtime, msg.filesize);
+                packfilemsg(reply, sendbuffer, starg.protover);
+                if (tcpserver.write(sendbuffer) == false)
+                {
+                    logfile.write("[recvfilesmain: send buffer failed] tcpserver.write(%s)\n", msg.filename.c_str());
+                    return;
+                }
+            }
+
+            reply.type = FMSG_ACK;
+            logfile.write("[_tcpgetfiles] recv %s(%ld) from %ld ... ", localfile.c_str(), msg.filesize, reply.offset);
+            if (recvfile(localfile, msg.mtime, msg.filesize, reply.offset, bresume, bcompress) == false)
             {
                 logfile << "failed\n";
-                sendbuffer.append("<result>failed</result>");
             }
             else
             {
                 logfile << "success\n";
-                sendbuffer.append("<result>success</result>");
+                reply.flags = FMSG_SUCCESS;
             }
 
             // 返回确认报文
-            //[Debug] logfile.write("[recvfilesmain] send %s ... ", sendbuffer.c_str());
+            packfilemsg(reply, sendbuffer, starg.protover);
+            //[Debug] logfile.write("[recvfilesmain] send %s ... ", msg.filename.c_str());
             if (tcpserver.write(sendbuffer) == false)
             {
                 //[Debug] logfile << "failed\n";
-                logfile.write("[recvfilesmain: send buffer failed] tcpserver.write(%s)\n", sendbuffer.c_str());
+                logfile.write("[recvfilesmain: send buffer failed] tcpserver.write(%s)\n", msg.filename.c_str());
                 return;
             }
             //[Debug] logfile << "success\n";
@@ -424,35 +589,677 @@ void recvfilesmain()
     }
 }
 
-bool recvfile(const string& filename, const string& mtime, const int filesize)
+bool recvfile(const string& filename, const string& mtime, const long filesize, 
+              const long offset, const bool bresume, const bool bcompress)
+{
+    // 先把文件的内容写入临时文件，接收完成后再改名，避免中间状态的文件被读取
+    string filenametmp = filename + ".tmp";
+
+    bool bok = (bcompress == true) ? tcpserver.recvfilez(filenametmp, filesize, offset)
+                                   : tcpserver.recvfile(filenametmp, filesize, offset);
+    if (bok == false)
+    {
+        // 可以断点续传的文件保留临时文件，并把它的时间设置为对端文件的时间，下次从断点处继续接收
+        if (bresume == true) setmtime(filenametmp, mtime);
+        else remove(filenametmp.c_str());
+
+        return false;
+    }
+
+    if (rename(filenametmp.c_str(), filename.c_str()) != 0)
+    {
+        logfile.write("[recvfile: rename file failed] rename(%s, %s): %s\n", filenametmp.c_str(), filename.c_str(), strerror(errno));
+        return false;
+    }
+
+    // 文件时间用当前时间没有意义，应该与对端的文件时间保持一致
+    setmtime(filename, mtime);
+
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// 以下是事件驱动模式（epoll）的代码
+
+// 客户端连接的状态
+enum
+{
+    ST_LOGIN = 0,   // 等待客户端的登录报文
+    ST_RECVHEAD,    // 接收文件的一端：等待文件信息或心跳报文
+    ST_RECVBODY,    // 接收文件的一端：正在接收文件的内容
+    ST_SENDFILES,   // 发送文件的一端：正在发送目录中的文件
+    ST_WAITACKS,    // 发送文件的一端：目录中的文件已发送完，等待剩余的确认报文
+    ST_IDLE,        // 发送文件的一端：没有文件可发，休眠timetvl秒
+    ST_ACTIVETEST   // 发送文件的一端：已发送心跳报文，等待对端的回应
+};
+
+// 一个客户端连接的上下文
+struct st_conn
+{
+    int fd = -1;                // 客户端的socket
+    string ip;                  // 客户端的ip地址
+    struct st_arg arg;          // 客户端的登录参数
+    int state = ST_LOGIN;       // 连接的状态
+    time_t deadline = 0;        // 当前状态的超时时间，0表示不超时
+
+    string inbuf;               // 已接收但未处理的数据
+    size_t inpos = 0;           // inbuf中未处理数据的起始位置
+    string outbuf;              // 待发送的报文
+    size_t outpos = 0;          // outbuf中未发送数据的起始位置
+    bool bwaitout = false;      // 是否在等待socket可写的事件
+    time_t sendline = 0;        // 有数据未发送完时的超时时间，每次发送成功后重新计时，0表示没有待发送的数据
+    bool bclosing = false;      // outbuf发送完后关闭连接
+
+    // 接收文件
+    int filefd = -1;            // 正在接收的临时文件
+    bool bfileok = true;        // 写入临时文件是否成功
+    string filename;            // 正在接收的文件名，不包括目录名
+    string mtime;               // 正在接收的文件的时间
+    long filesize = 0;          // 正在接收的文件的大小
+    long remain = 0;            // 剩余需要接收的字节数
+
+    // 发送文件
+    unique_ptr<cdir> dir;       // 本次发送任务的文件列表
+    bool bsent = false;         // 本次发送任务是否发送了文件
+    csendwindow window;         // 已发送但未收到对端确认报文的文件
+    int sendfd = -1;            // 正在发送的文件
+    off_t sendpos = 0;          // 文件中下一次发送的位置
+    long sendleft = 0;          // 剩余需要发送的字节数
+};
+
+int epollfd = -1;                               // 工作进程的epoll句柄
+unordered_map<int, unique_ptr<st_conn>> conns;  // 工作进程的全部连接，key为socket
+
+void acceptconns();                                     // 接受全部已连接的客户端
+void closeconn(st_conn& conn);                          // 关闭客户端的连接，释放资源
+bool onread(st_conn& conn);                             // 处理socket可读的事件
+bool onwrite(st_conn& conn);                            // 处理socket可写的事件
+bool processinput(st_conn& conn);                       // 处理接收缓冲区中的数据
+bool handlemessage(st_conn& conn, const string& message); // 处理一个完整的报文
+void queuemessage(st_conn& conn, const string& message);  // 把报文放入发送缓冲区
+bool flush(st_conn& conn);                              // 发送缓冲区中的报文和正在发送的文件
+bool waitout(st_conn& conn, const bool bwait);          // 设置是否等待socket可写的事件
+bool startscan(st_conn& conn);                          // 开始一次发送任务
+bool pumpfiles(st_conn& conn);                          // 依次发送目录中的文件
+void startrecv(st_conn& conn, const st_filemsg& msg);   // 开始接收一个文件
+void finishrecv(st_conn& conn);                         // 文件接收完成
+bool checktimer(st_conn& conn, const time_t now);       // 处理连接的超时
+
+void epollmain(const int workers)
+{
+    int nworkers = workers > 0 ? workers : 1;
+
+    // 监听的socket设置为非阻塞，多个工作进程都在等待连接，没有抢到连接的进程不会阻塞在accept上
+    int listenfd = tcpserver.listenfd();
+    fcntl(listenfd, F_SETFL, fcntl(listenfd, F_GETFL) | O_NONBLOCK);
+
+    for (int ii = 0; ii < nworkers; ++ii)
+    {
+        if (fork() == 0) epollworker();
+    }
+
+    logfile.write("[epollmain] %d workers started\n", nworkers);
+
+    // 父进程只负责监视工作进程，如果工作进程异常退出，就重新启动一个
+    while (true)
+    {
+        int status;
+        pid_t pid = wait(&status);
+        if (pid < 0)
+        {
+            if (errno != EINTR) sleep(1);
+            continue;
+        }
+
+        logfile.write("[epollmain] worker(%d) exited, status=%d, restart it\n", pid, status);
+        sleep(1);
+
+        if (fork() == 0) epollworker();
+    }
+}
+
+void epollworker()
 {
-    int onread = 0;
-    int totalbytes = 0;
-    char buffer[1024];
+    // 工作进程重新设置处理函数
+    signal(SIGINT,ChldEXIT); signal(SIGTERM,ChldEXIT);
+
+    pactive.addpinfo(60, sformat("fileserver_worker_%d", getpid()));
+
+    if ((epollfd = epoll_create1(0)) < 0)
+    {
+        logfile.write("[epollworker: create epoll failed] epoll_create1()\n");
+        ChldEXIT(-1);
+    }
+
+    // 多个工作进程监听同一个socket，EPOLLEXCLUSIVE避免一个连接唤醒全部的工作进程
+    struct epoll_event ev;
+    ev.data.fd = tcpserver.listenfd();
+    ev.events = EPOLLIN;
+#ifdef EPOLLEXCLUSIVE
+    ev.events |= EPOLLEXCLUSIVE;
+#endif
+    epoll_ctl(epollfd, EPOLL_CTL_ADD, ev.data.fd, &ev);
+
+    struct epoll_event evs[256];
+    time_t lasttime = 0;
+
+    while (true)
+    {
+        int infds = epoll_wait(epollfd, evs, 256, 1000);
+        if ((infds < 0) && (errno != EINTR))
+        {
+            logfile.write("[epollworker: epoll_wait failed] %s\n", strerror(errno));
+            ChldEXIT(-1);
+        }
 
-    cofile ofile;
-    if (ofile.open(filename, true, ios::out | ios::binary) == false) return false;
+        for (int ii = 0; ii < infds; ++ii)
+        {
+            if (evs[ii].data.fd == tcpserver.listenfd()) { acceptconns(); continue; }
+
+            auto it = conns.find(evs[ii].data.fd);
+            if (it == conns.end()) continue;
+            st_conn& conn = *it->second;
+
+            bool bok = true;
+            if (evs[ii].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) bok = onread(conn);
+            if (bok && (evs[ii].events & EPOLLOUT)) bok = onwrite(conn);
+
+            if (bok == false) closeconn(conn);
+        }
+
+        // 每秒检查一次全部连接的超时
+        time_t now = time(0);
+        if (now == lasttime) continue;
+        lasttime = now;
 
-    while (totalbytes < filesize)
+        vector<int> timeoutfds;
+        for (auto& it : conns)
+        {
+            if (checktimer(*it.second, now) == false) timeoutfds.push_back(it.first);
+        }
+        for (auto fd : timeoutfds) closeconn(*conns[fd]);
+
+        pactive.uptatime();
+    }
+}
+
+void acceptconns()
+{
+    while (true)
     {
-        memset(buffer, 0, sizeof(buffer));
+        struct sockaddr_in clientaddr;
+        socklen_t socklen = sizeof(clientaddr);
+        int fd = accept4(tcpserver.listenfd(), (struct sockaddr *)&clientaddr, &socklen, SOCK_NONBLOCK);
+        if (fd < 0)
+        {
+            if (errno == EINTR) continue;
 
-        onread = (filesize - totalbytes) > 1024 ? 1024 : (filesize - totalbytes);
+            // EAGAIN表示已连接队列中没有连接了，可能是被其它工作进程抢走了
+            if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+                logfile.write("[acceptconns: accept client failed] %s\n", strerror(errno));
+            return;
+        }
+
+        unique_ptr<st_conn> conn(new st_conn);
+        conn->fd = fd;
+        conn->ip = inet_ntoa(clientaddr.sin_addr);
+        conn->deadline = time(0) + 30;       // 30秒内没有收到登录报文就关闭连接
+        memset(&conn->arg, 0, sizeof(struct st_arg));
 
-        if (tcpserver.read(buffer, onread) == false) return false;
+        struct epoll_event ev;
+        ev.data.fd = fd;
+        ev.events = EPOLLIN;
+        epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &ev);
 
-        ofile.write(buffer, onread);
+        logfile.write("accept client(%s) success\n", conn->ip.c_str());
 
-        totalbytes += onread;
+        conns[fd] = move(conn);
     }
-    ofile.closeandrename();
+}
 
-    // 文件时间用当前时间没有意义，应该与对端的文件时间保持一致
-    setmtime(filename, mtime);
+void closeconn(st_conn& conn)
+{
+    int fd = conn.fd;
+
+    logfile.write("[closeconn] client(%s) disconnected\n", conn.ip.c_str());
+
+    epoll_ctl(epollfd, EPOLL_CTL_DEL, fd, 0);
+    close(fd);
+
+    // 没有接收完的临时文件要删除
+    if (conn.filefd != -1)
+    {
+        close(conn.filefd);
+        remove(sformat("%s/%s.tmp", conn.arg.srvpath, conn.filename.c_str()).c_str());
+    }
+
+    if (conn.sendfd != -1) close(conn.sendfd);
+
+    conns.erase(fd);    // conn已被释放，不能再使用
+}
+
+bool onread(st_conn& conn)
+{
+    static char buffer[262144];     // 工作进程是单线程的，可以共用一个缓冲区
+
+    ssize_t nread = recv(conn.fd, buffer, sizeof(buffer), 0);
+    if (nread < 0) return (errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR);
+    if (nread == 0) return false;   // 对端已关闭连接
+
+    // 把已处理的数据从接收缓冲区中清除，再追加本次接收的数据
+    if (conn.inpos > 0) { conn.inbuf.erase(0, conn.inpos); conn.inpos = 0; }
+    conn.inbuf.append(buffer, nread);
+
+    // 接收文件的一端，只要有数据到达，就说明对端是活动的
+    if ((conn.state == ST_RECVHEAD) || (conn.state == ST_RECVBODY))
+        conn.deadline = time(0) + conn.arg.timetvl + 10;
+
+    if (processinput(conn) == false) return false;
+
+    return onwrite(conn);
+}
+
+bool onwrite(st_conn& conn)
+{
+    if (flush(conn) == false) return false;
+
+    // 当前的文件已发送完，继续发送下一个文件
+    if (conn.state == ST_SENDFILES) return pumpfiles(conn);
 
     return true;
 }
 
+bool processinput(st_conn& conn)
+{
+    while (true)
+    {
+        // 正在接收文件的内容
+        if (conn.state == ST_RECVBODY)
+        {
+            long n = conn.inbuf.size() - conn.inpos;
+            if (n > conn.remain) n = conn.remain;
+
+            for (long idx = 0; (conn.bfileok == true) && (idx < n); )
+            {
+                ssize_t nwritten = write(conn.filefd, &conn.inbuf[conn.inpos + idx], n - idx);
+                if ((nwritten < 0) && (errno == EINTR)) continue;
+                if (nwritten <= 0) { conn.bfileok = false; break; }
+                idx = idx + nwritten;
+            }
+
+            conn.inpos = conn.inpos + n;
+            conn.remain = conn.remain - n;
+
+            if (conn.remain > 0) return true;
+
+            finishrecv(conn);
+            continue;
+        }
+
+        // 报文的格式与tcpwrite()相同：4字节的报文长度+报文内容
+        if (conn.inbuf.size() - conn.inpos < 4) return true;
+
+        int buflen;
+        memcpy(&buflen, &conn.inbuf[conn.inpos], 4);
+        if ((buflen < 0) || (buflen > 1048576))
+        {
+            logfile.write("[processinput] client(%s) invalid message length %d\n", conn.ip.c_str(), buflen);
+            return false;
+        }
+
+        if (conn.inbuf.size() - conn.inpos - 4 < (size_t)buflen) return true;
+
+        string message = conn.inbuf.substr(conn.inpos + 4, buflen);
+        conn.inpos = conn.inpos + 4 + buflen;
+
+        if (handlemessage(conn, message) == false) return false;
+    }
+}
+
+bool handlemessage(st_conn& conn, const string& message)
+{
+    // 登录报文
+    if (conn.state == ST_LOGIN)
+    {
+        parselogin(message, conn.arg);
+
+        // 判断客户端类型是否合法
+        if ((conn.arg.clienttype != 1) && (conn.arg.clienttype != 2))
+        {
+            logfile.write("[handlemessage] client(%s) clienttype is illegal\n", conn.ip.c_str());
+            queuemessage(conn, "failed");
+            conn.bclosing = true;
+            return true;
+        }
+
+        // 事件驱动模式不支持断点续传和压缩传输，大文件也从头发送，报文只用xml格式
+        conn.arg.resume = false;
+        conn.arg.compress = false;
+        conn.arg.protover = 1;
+        queuemessage(conn, loginreply(conn.arg, false));
+        logfile.write("[client login success] client(%s) pname=%s\n", conn.ip.c_str(), conn.arg.pname);
+
+        if (conn.arg.clienttype == 1) return startscan(conn);
+
+        conn.state = ST_RECVHEAD;
+        conn.deadline = time(0) + conn.arg.timetvl + 10;
+        return true;
+    }
+
+    // 登录之后的报文与多进程模式相同，按报文的类型处理，格式不正确的报文忽略
+    st_filemsg msg;
+    if (unpackfilemsg(message, msg) == false) return true;
+
+    // 接收文件的一端，来自对端的报文是心跳报文或上传文件的请求报文
+    if (conn.state == ST_RECVHEAD)
+    {
+        switch (msg.type)
+        {
+            case FMSG_ACTIVETEST:
+            {
+                string sendbuffer;
+                msg.type = FMSG_ACTIVEOK;
+                packfilemsg(msg, sendbuffer, conn.arg.protover);
+                queuemessage(conn, sendbuffer);
+                return true;
+            }
+
+            case FMSG_FILEHEAD:
+                startrecv(conn, msg);
+                return true;
+
+            default:
+                return true;
+        }
+    }
+
+    // 发送文件的一端，来自对端的报文是确认报文或心跳报文的回应
+    switch (msg.type)
+    {
+        case FMSG_ACK:
+        {
+            ackmessage(message, conn.window, conn.arg);
+
+            // 剩余的确认报文都收到了，开始下一次发送任务，否则重新计时
+            if (conn.state == ST_WAITACKS)
+            {
+                if (conn.window.empty() == true) return startscan(conn);
+                conn.deadline = time(0) + ACKTIMEOUT;
+            }
+
+            // 发送窗口有空位了，继续发送文件
+            if (conn.state == ST_SENDFILES) return pumpfiles(conn);
+
+            return true;
+        }
+
+        case FMSG_ACTIVEOK:
+            if (conn.state == ST_ACTIVETEST) return startscan(conn);
+            return true;
+
+        default:
+            return true;
+    }
+}
+
+void queuemessage(st_conn& conn, const string& message)
+{
+    int buflen = message.size();
+
+    conn.outbuf.append((char *)&buflen, 4);
+    conn.outbuf.append(message);
+}
+
+bool flush(st_conn& conn)
+{
+    long budget = 8388608;      // 每次最多发送8M文件内容，避免一个连接占用工作进程太久
+    bool bprogress = false;     // 本次是否发送成功了数据
+    bool bpending = false;      // 是否还有数据未发送完
+
+    while (true)
+    {
+        // 先发送缓冲区中的报文
+        if (conn.outpos < conn.outbuf.size())
+        {
+            ssize_t nsent = send(conn.fd, &conn.outbuf[conn.outpos], conn.outbuf.size() - conn.outpos, MSG_NOSIGNAL);
+            if (nsent > 0) { conn.outpos = conn.outpos + nsent; bprogress = true; continue; }
+            if ((nsent < 0) && (errno == EINTR)) continue;
+            if ((nsent < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) { bpending = true; break; }
+            return false;
+        }
+
+        conn.outbuf.clear();
+        conn.outpos = 0;
+
+        if (conn.sendfd == -1) break;
+
+        // 文件已发送完
+        if (conn.sendleft == 0)
+        {
+            close(conn.sendfd);
+            conn.sendfd = -1;
+            conn.window.push(0, conn.dir->m_filename, conn.dir->m_filesize);
+            logfile.write("[_sendfiles] send %s(%ld) to %s success\n", 
+                conn.dir->m_filename.c_str(), conn.dir->m_filesize, conn.ip.c_str());
+            break;
+        }
+
+        if (budget <= 0) { bpending = true; break; }
+
+        // 再发送文件的内容
+        ssize_t nsent = sendfile(conn.fd, conn.sendfd, &conn.sendpos, conn.sendleft > budget ? budget : conn.sendleft);
+        if (nsent > 0) { conn.sendleft = conn.sendleft - nsent; budget = budget - nsent; bprogress = true; continue; }
+        if ((nsent < 0) && (errno == EINTR)) continue;
+        if ((nsent < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) { bpending = true; break; }
+
+        // 内核或文件系统不支持sendfile，把文件的内容读到发送缓冲区中
+        if ((nsent < 0) && ((errno == EINVAL) || (errno == ENOSYS)))
+        {
+            conn.outbuf.resize(conn.sendleft > 65536 ? 65536 : conn.sendleft);
+            ssize_t nread = pread(conn.sendfd, &conn.outbuf[0], conn.outbuf.size(), conn.sendpos);
+            if (nread <= 0) return false;
+            conn.outbuf.resize(nread);
+            conn.sendpos = conn.sendpos + nread;
+            conn.sendleft = conn.sendleft - nread;
+            budget = budget - nread;
+            continue;
+        }
+
+        // nsent==0表示文件已被截断，其它情况是socket连接已不可用
+        logfile.write("[flush] send %s to %s failed\n", conn.dir->m_ffilename.c_str(), conn.ip.c_str());
+        return false;
+    }
+
+    // 还有数据未发送完，等待socket可写的事件，对端ACKTIMEOUT秒内不接收任何数据就关闭连接
+    if (bpending == true)
+    {
+        if ((bprogress == true) || (conn.sendline == 0)) conn.sendline = time(0) + ACKTIMEOUT;
+        return waitout(conn, true);
+    }
+
+    conn.sendline = 0;
+
+    // 全部数据已发送完，如果是登录失败的连接，现在可以关闭了
+    if (conn.bclosing == true) return false;
+
+    return waitout(conn, false);
+}
+
+bool waitout(st_conn& conn, const bool bwait)
+{
+    if (conn.bwaitout == bwait) return true;
+
+    struct epoll_event ev;
+    ev.data.fd = conn.fd;
+    ev.events = bwait ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+    if (epoll_ctl(epollfd, EPOLL_CTL_MOD, conn.fd, &ev) != 0) return false;
+
+    conn.bwaitout = bwait;
+
+    return true;
+}
+
+bool startscan(st_conn& conn)
+{
+    conn.dir.reset(new cdir);
+    if (conn.dir->opendir(conn.arg.srvpath, conn.arg.matchname, 10000, conn.arg.andchild, false) == false)
+    {
+        logfile.write("[startscan: open directory failed] dir.opendir(%s)\n", conn.arg.srvpath);
+        return false;
+    }
+
+    conn.state = ST_SENDFILES;
+    conn.deadline = 0;
+    conn.bsent = false;
+
+    return pumpfiles(conn);
+}
+
+bool pumpfiles(st_conn& conn)
+{
+    // 上一个文件的报文和内容都发送完了，并且发送窗口未满，才能发送下一个文件
+    // 窗口满了就等待确认报文，收到确认报文后再继续
+    while ((conn.state == ST_SENDFILES) && (conn.outbuf.empty() == true) && (conn.sendfd == -1) && 
+           (conn.window.full() == false))
+    {
+        if (conn.dir->readdir() == false)
+        {
+            if (conn.bsent == true)
+            {
+                // 等待剩余的确认报文，每收到一个报文重新计时
+                conn.state = ST_WAITACKS;
+                conn.deadline = time(0) + ACKTIMEOUT;
+                if (conn.window.empty() == true) return startscan(conn);
+            }
+            else
+            {
+                // 没有文件可发，休眠timetvl秒后发送心跳报文
+                conn.state = ST_IDLE;
+                conn.deadline = time(0) + conn.arg.timetvl;
+            }
+
+            return true;
+        }
+
+        // 客户端用多个连接下载文件时，只发送分配给本连接的文件
+        if (mystream(conn.dir->m_filename, conn.arg) == false) continue;
+
+        if ((conn.sendfd = open(conn.dir->m_ffilename.c_str(), O_RDONLY)) < 0)
+        {
+            logfile.write("[pumpfiles: open file failed] open(%s)\n", conn.dir->m_ffilename.c_str());
+            continue;
+        }
+
+        conn.sendpos = 0;
+        conn.sendleft = conn.dir->m_filesize;
+        conn.bsent = true;
+        conn.deadline = 0;
+
+        // 先向对端发送文件信息，再发送文件的内容
+        queuemessage(conn, sformat("<filename>%s</filename><filesize>%ld</filesize><mtime>%s</mtime>", 
+            conn.dir->m_filename.c_str(), conn.dir->m_filesize, conn.dir->m_mtime.c_str()));
+
+        if (flush(conn) == false) return false;
+    }
+
+    // 发送窗口已满，对端在ACKTIMEOUT秒内没有确认报文就关闭连接
+    if ((conn.state == ST_SENDFILES) && (conn.window.full() == true)) conn.deadline = time(0) + ACKTIMEOUT;
+
+    return true;
+}
+
+void startrecv(st_conn& conn, const st_filemsg& msg)
+{
+    conn.filename = msg.filename;
+    conn.mtime = msg.mtime;
+    conn.filesize = msg.filesize;
+
+    conn.remain = conn.filesize;
+    conn.bfileok = true;
+
+    // 先把文件的内容写入临时文件，接收完成后再改名
+    string filenametmp = sformat("%s/%s.tmp", conn.arg.srvpath, conn.filename.c_str());
+    newdir(filenametmp, true);
+    if ((conn.filefd = open(filenametmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+    {
+        logfile.write("[startrecv: open file failed] open(%s)\n", filenametmp.c_str());
+        conn.bfileok = false;       // 文件的内容还是要接收，但不写入文件
+    }
+    else if (conn.filesize > 0) fallocate(conn.filefd, 0, 0, conn.filesize);
+
+    conn.state = ST_RECVBODY;
+}
+
+void finishrecv(st_conn& conn)
+{
+    string filename = sformat("%s/%s", conn.arg.srvpath, conn.filename.c_str());
+    string filenametmp = filename + ".tmp";
+
+    if (conn.filefd != -1)
+    {
+        if (close(conn.filefd) != 0) conn.bfileok = false;
+        conn.filefd = -1;
+    }
+
+    string sendbuffer = sformat("<filename>%s</filename>", conn.filename.c_str());
+
+    if ((conn.bfileok == true) && (rename(filenametmp.c_str(), filename.c_str()) != 0))
+    {
+        logfile.write("[finishrecv: rename file failed] rename(%s, %s): %s\n", filenametmp.c_str(), filename.c_str(), strerror(errno));
+        conn.bfileok = false;
+    }
+
+    if (conn.bfileok == true)
+    {
+        // 文件时间用当前时间没有意义，应该与对端的文件时间保持一致
+        setmtime(filename, conn.mtime);
+        logfile.write("[_tcpgetfiles] recv %s(%ld) from %s success\n", filename.c_str(), conn.filesize, conn.ip.c_str());
+        sendbuffer.append("<result>success</result>");
+    }
+    else
+    {
+        remove(filenametmp.c_str());
+        logfile.write("[_tcpgetfiles] recv %s(%ld) from %s failed\n", filename.c_str(), conn.filesize, conn.ip.c_str());
+        sendbuffer.append("<result>failed</result>");
+    }
+
+    // 返回确认报文
+    queuemessage(conn, sendbuffer);
+
+    conn.state = ST_RECVHEAD;
+}
+
+bool checktimer(st_conn& conn, const time_t now)
+{
+    // 报文或文件的内容长时间发送不出去，对端已不接收数据，关闭连接，释放socket和正在发送的文件
+    if ((conn.sendline != 0) && (now >= conn.sendline))
+    {
+        logfile.write("[checktimer] client(%s) send timeout, state=%d\n", conn.ip.c_str(), conn.state);
+        return false;
+    }
+
+    if ((conn.deadline == 0) || (now < conn.deadline)) return true;
+
+    switch (conn.state)
+    {
+        case ST_WAITACKS:
+            // 每个文件都要确认，超时说明连接已不可用，关闭连接，客户端重新连接后未确认的文件会重新发送
+            logfile.write("[checktimer] client(%s) %d files not acknowledged\n", conn.ip.c_str(), (int)conn.window.size());
+            return false;
+
+        case ST_IDLE:
+            // 没有文件可发，向对端发送心跳报文，20秒内没有回应就关闭连接
+            queuemessage(conn, "<activetest>ok</activetest>");
+            conn.state = ST_ACTIVETEST;
+            conn.deadline = now + 20;
+            return flush(conn);
+
+        default:
+            logfile.write("[checktimer] client(%s) timeout, state=%d\n", conn.ip.c_str(), conn.state);
+            return false;
+    }
+}
+
 void FathEXIT(int sig)
 {
     // 防止信号处理函数在执行的过程中被信号中断。
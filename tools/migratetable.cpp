@@ -92,6 +92,7 @@ bool _migratetable()
     sqlstatement stmtsel(&conn);
     stmtsel.prepare("select %s from %s %s", starg.keycol, starg.tname, starg.where);
     stmtsel.bindout(1, keyvalue);
+    stmtsel.setprefetch(starg.maxcount);  // 每次从数据库预取maxcount条记录，减少网络往返
 
     // 准备插入目的表的sql
     // 每次最多maxcount条记录
@@ -157,6 +157,7 @@ bool _syncref()
     stmtsel.prepare("select %s from %s %s", starg.remotekeycol, starg.remotetname, starg.rwhere);
     char remkeyvalue[starg.keylen + 1];
     stmtsel.bindout(1, remkeyvalue, starg.keylen);
+    stmtsel.setprefetch(starg.maxcount);  // 每次从数据库预取maxcount条记录，减少网络往返
 
     // 拼接绑定部分的字符串
     string binds;
@@ -22,19 +22,29 @@ struct st_arg
     int timetvl;
     int timeout;
     char pname[64];
+    int streams;        // 与服务端建立的连接数
+    char compress[11];  // 文件内容的压缩方式，none-不压缩，zlib-用zlib压缩
 }starg;
 
 clogfile logfile;       // 日志
 cpactive pactive;       // 进程心跳
-ctcpclient tcpclient;   // tcp客户端
 
-string sendbuffer;      // 发送报文
-string recvbuffer;      // 接收报文
+// 一个下载文件的连接，服务端按文件名把文件分配到各连接上，每个连接由一个线程负责
+struct st_stream
+{
+    int id = 0;             // 连接的编号，从0开始
+    ctcpclient tcpclient;   // tcp客户端
+};
+
+vector<unique_ptr<st_stream>> vstreams; // 全部的连接
+atomic<bool> bexit(false);              // 有连接已不可用，全部的线程退出
+int protover = 1;                       // 与服务端协商的协议版本，1-xml格式的报文，2-二进制格式的报文
 
-bool login(const char* argv); // 登录函数，向服务端发送本程序的信息（运行参数）
+bool login(st_stream& stream, const char* argv, string& recvbuffer); // 登录函数，向服务端发送本程序的信息（运行参数）
 
-void _tcpgetfiles();    // 下载文件的主函数
-bool recvfile(const string& filename, const string& mtime, const int filesize); // 接收一次文件传输的函数，使用绝对路径        
+void _tcpgetfiles(st_stream& stream); // 下载文件的主函数，每个连接一个
+bool recvfile(st_stream& stream, const string& filename, const string& mtime, const long filesize, 
+              const long offset, const bool bresume, const bool bcompress); // 接收一次文件传输的函数，使用绝对路径，offset为断点续传的位置
 
 void EXIT(int sig);     // 退出函数
 void _help();           // 帮助文档
@@ -66,147 +76,199 @@ int main(int argc, char* argv[])
     // 配置心跳信息
     pactive.addpinfo(starg.timeout, starg.pname);
 
-    // 连接tcp服务端
-    if (tcpclient.connect(starg.ip, starg.port) == false)
+    // 连接tcp服务端并登录，每个连接都要登录
+    for (int i = 0; i < starg.streams; ++i)
     {
-        logfile.write("[connect failed] tcpclient.connect(%s, %d)\n", starg.ip, starg.port);
-        EXIT(-1);
+        vstreams.emplace_back(new st_stream);
+        st_stream& stream = *vstreams.back();
+        stream.id = i;
+
+        if (stream.tcpclient.connect(starg.ip, starg.port) == false)
+        {
+            logfile.write("[connect failed] tcpclient.connect(%s, %d)\n", starg.ip, starg.port);
+            EXIT(-1);
+        }
+
+        string recvbuffer;
+        if (login(stream, argv[2], recvbuffer) == false) 
+        {
+            logfile.write("[login failed] stream %d\n", i);
+            EXIT(-1);
+        }
+
+        // 服务端的回应中没有<streams>，表示服务端不支持把文件分配到多个连接，只能用一个连接
+        if ((i == 0) && (starg.streams > 1) && (recvbuffer.find("<streams>") == string::npos))
+        {
+            logfile.write("[login] server does not support streams, use 1 stream\n");
+            starg.streams = 1;
+        }
+
+        // 服务端的回应中没有<compress>，表示服务端不支持压缩传输，文件按原样下载
+        if ((i == 0) && (strcmp(starg.compress, "zlib") == 0) && (recvbuffer.find("<compress>zlib</compress>") == string::npos))
+        {
+            logfile.write("[login] server does not support compress, transfer without compress\n");
+            strcpy(starg.compress, "none");
+        }
+
+        // 服务端的回应中没有<protover>，表示服务端是旧版本，只能用xml格式的报文
+        if (i == 0)
+        {
+            getxmlbuffer(recvbuffer, "protover", protover);
+            if ((protover < 1) || (protover > PROTOVER)) protover = 1;
+        }
     }
+    logfile.write("[login success] streams=%d, compress=%s, protover=%d\n", starg.streams, starg.compress, protover);
 
-    // 登录
-    if (login(argv[2]) == false) 
+    if (starg.streams == 1)
     {
-        logfile.write("[login failed]\n");
-        EXIT(-1);
+        _tcpgetfiles(*vstreams[0]);
+        return 0;
     }
-    logfile.write("[login success]\n");
 
-    _tcpgetfiles();
+    // 每个连接启动一个线程，任何一个连接不可用，全部的线程退出，由调度程序重新启动本程序
+    vector<thread> vthreads;
+    for (auto& stream : vstreams)
+        vthreads.emplace_back(_tcpgetfiles, ref(*stream));
+
+    for (auto& th : vthreads) th.join();
 
     return 0;
 }
 
-bool login(const char* argv)
+bool login(st_stream& stream, const char* argv, string& recvbuffer)
 {
+    string sendbuffer;
+
     // 向服务端发送登录报文
     // 登录报文包含客户端的类型以及其它服务端所需的信息，这里直接将整个argv[2]传过去更方便
-    sformat(sendbuffer, "%s<clienttype>1</clienttype>", argv);
+    // 多个连接时，还要告诉服务端本连接的编号，服务端只在本连接上发送分配给它的文件
+    // <resume>告诉服务端本程序支持大文件的断点续传，<protover>告诉服务端本程序支持的最高协议版本
+    sformat(sendbuffer, "%s<clienttype>1</clienttype><streamid>%d</streamid><resume>true</resume><protover>%d</protover>", 
+            argv, stream.id, PROTOVER);
 
-    //[Debug] logfile.write("[login] send %s ... ", sendbuffer.c_str());
-    if (tcpclient.write(sendbuffer) == false) 
+    if (stream.tcpclient.write(sendbuffer) == false) 
     {
-        //[Debug] logfile << "failed\n";
         logfile.write("[login: send buffer failed] tcpclient.write(%s)\n", sendbuffer.c_str());
         return false;
     }
-    //[Debug] logfile << "success\n";
 
     // 接收服务端的报文
-    //[Debug] logfile.write("[login] recv ... ");
-    if (tcpclient.read(recvbuffer) == false)
+    if (stream.tcpclient.read(recvbuffer) == false)
     {
-        //[Debug] logfile << "failed\n";
         logfile.write("[login: recv buffer failed] tcpclient.read()\n");
         return false;
     }
-    //[Debug] logfile << "success\n";
 
     if (recvbuffer == "failed") return false;
 
     return true;
 }
 
-void _tcpgetfiles()
+void _tcpgetfiles(st_stream& stream)
 {
-    while (true)
+    string sendbuffer;
+    string recvbuffer;
+
+    while (bexit == false)
     {
         pactive.uptatime();
 
-        //[Debug] logfile.write("[_tcpgetfiles] recv ... ");
-        if (tcpclient.read(recvbuffer, starg.timetvl+10) == false)
+        if (stream.tcpclient.read(recvbuffer, starg.timetvl+10) == false)
         {
-            //[Debug] logfile << "failed\n";
-            logfile.write("[[_tcpgetfiles: recv buffer failed] tcpclient.read()\n");
-            return;
+            logfile.write("[_tcpgetfiles: recv buffer failed] stream %d tcpclient.read()\n", stream.id);
+            break;
         }
-        //[Debug] logfile << sformat("success, buffer: %s\n", recvbuffer.c_str());
+
+        st_filemsg msg;
+        if (unpackfilemsg(recvbuffer, msg) == false) continue;
 
         // 处理心跳报文
-        if (recvbuffer == "<activetest>ok</activetest>")
+        if (msg.type == FMSG_ACTIVETEST)
         {
-            sendbuffer = "ok";
-            if (tcpclient.write(sendbuffer) == false)
+            msg.type = FMSG_ACTIVEOK;
+            packfilemsg(msg, sendbuffer, protover);
+            if (stream.tcpclient.write(sendbuffer) == false)
             {
-                logfile.write("[_tcpgetfiles: send buffer failed] tcpclient.write(%s)\n", sendbuffer.c_str());
-                return;
+                logfile.write("[_tcpgetfiles: send buffer failed] stream %d tcpclient.write()\n", stream.id);
+                break;
             }
         }
 
-        // 处理发送文件的请求报文
-        if (recvbuffer.find("<filename>") != string::npos)
+        // 处理发送文件的请求报文，服务端对每个文件决定是否断点续传和压缩
+        if (msg.type == FMSG_FILEHEAD)
         {
-            string filename;
-            string mtime;
-            int filesize;
-
-            getxmlbuffer(recvbuffer, "filename", filename);
-            getxmlbuffer(recvbuffer, "mtime", mtime);
-            getxmlbuffer(recvbuffer, "filesize", filesize);
-
-            string localfile = sformat("%s/%s", starg.clientpath, filename.c_str());
-            sendbuffer = sformat("<filename>%s</filename>", filename.c_str());
-            logfile.write("[_tcpgetfiles] recv %s(%d) ... ", localfile.c_str(), filesize);
-            if (recvfile(localfile, mtime, filesize) == false)
+            bool bresume = (msg.flags & FMSG_RESUME) != 0;
+            bool bcompress = (msg.flags & FMSG_COMPRESS) != 0;
+
+            string localfile = sformat("%s/%s", starg.clientpath, msg.filename.c_str());
+
+            // 大文件断点续传：告诉服务端临时文件中已接收的字节数，服务端从这个位置开始发送
+            // 回应报文和确认报文沿用文件信息报文的序号和文件名
+            st_filemsg reply = msg;
+            reply.flags = 0;
+            reply.offset = 0;
+            if (bresume == true)
             {
-                logfile << "failed\n";
-                sendbuffer.append("<result>failed</result>");
+                reply.type = FMSG_OFFSET;
+                reply.offset = resumeoffset(localfile + ".tmp", msg.mtime, msg.filesize);
+                packfilemsg(reply, sendbuffer, protover);
+                if (stream.tcpclient.write(sendbuffer) == false)
+                {
+                    logfile.write("[_tcpgetfiles: send buffer failed] stream %d tcpclient.write(%s)\n", stream.id, msg.filename.c_str());
+                    break;
+                }
+            }
+
+            reply.type = FMSG_ACK;
+            if (recvfile(stream, localfile, msg.mtime, msg.filesize, reply.offset, bresume, bcompress) == false)
+            {
+                logfile.write("[_tcpgetfiles] recv %s(%ld) from %ld ... failed\n", localfile.c_str(), msg.filesize, reply.offset);
             }
             else
             {
-                logfile << "success\n";
-                sendbuffer.append("<result>success</result>");
+                logfile.write("[_tcpgetfiles] recv %s(%ld) from %ld ... success\n", localfile.c_str(), msg.filesize, reply.offset);
+                reply.flags = FMSG_SUCCESS;
             }
 
             // 返回确认报文
-            //[Debug] logfile.write("[_tcpgetfiles] send %s ... ", sendbuffer.c_str());
-            if (tcpclient.write(sendbuffer) == false)
+            packfilemsg(reply, sendbuffer, protover);
+            if (stream.tcpclient.write(sendbuffer) == false)
             {
-                //[Debug] logfile << "failed\n";
-                logfile.write("[_tcpgetfiles: send buffer failed] tcpclient.write(%s)\n", sendbuffer.c_str());
-                return;
+                logfile.write("[_tcpgetfiles: send buffer failed] stream %d tcpclient.write(%s)\n", stream.id, msg.filename.c_str());
+                break;
             }
-            //[Debug] logfile << "success\n";
         }
     }
+
+    bexit = true;
 }
 
-bool recvfile(const string& filename, const string& mtime, const int filesize)
+bool recvfile(st_stream& stream, const string& filename, const string& mtime, const long filesize, 
+              const long offset, const bool bresume, const bool bcompress)
 {
-    int onread = 0;
-    int totalbytes = 0;
-    char buffer[1024];
+    // 先把文件的内容写入临时文件，接收完成后再改名，避免中间状态的文件被读取
+    string filenametmp = filename + ".tmp";
 
-    cofile ofile;
-    if (ofile.open(filename, true, ios::out | ios::binary) == false)
+    bool bok = (bcompress == true) ? stream.tcpclient.recvfilez(filenametmp, filesize, offset)
+                                   : stream.tcpclient.recvfile(filenametmp, filesize, offset);
+    if (bok == false)
     {
-        logfile.write("[getfile: open file failed] ofile.open(%s)\n", filename.c_str());
+        logfile.write("[recvfile: recv file failed] tcpclient.recvfile(%s, %ld, %ld)\n", filenametmp.c_str(), filesize, offset);
+
+        // 可以断点续传的文件保留临时文件，并把它的时间设置为对端文件的时间，下次从断点处继续接收
+        if (bresume == true) setmtime(filenametmp, mtime);
+        else remove(filenametmp.c_str());
+
         return false;
     }
 
-    while (totalbytes < filesize)
+    if (rename(filenametmp.c_str(), filename.c_str()) != 0)
     {
-        memset(buffer, 0, sizeof(buffer));
-
-        onread = (filesize - totalbytes) > 1024 ? 1024 : (filesize - totalbytes);
-
-        if (tcpclient.read(buffer, onread) == false) return false;
-
-        ofile.write(buffer, onread);
-
-        totalbytes += onread;
+        logfile.write("[recvfile: rename file failed] rename(%s, %s): %s\n", filenametmp.c_str(), filename.c_str(), strerror(errno));
+        return false;
     }
-    ofile.closeandrename();
 
+    // 文件时间用当前时间没有意义，应该与对端的文件时间保持一致
     setmtime(filename, mtime);
 
     return true;
@@ -245,7 +307,12 @@ void _help()
     "clientpath    客户端文件存放的根目录\n"
     "timetvl       扫描服务目录文件的时间间隔，单位：秒，取值在1-30之间\n"
     "timeout       本程序的超时时间，单位：秒，视文件大小和网络带宽而定，建议设置50以上\n"
-    "pname         进程名，尽可能采用易懂的、与其它进程不同的名称，方便故障排查\n\n";
+    "pname         进程名，尽可能采用易懂的、与其它进程不同的名称，方便故障排查\n"
+    "streams       与服务端建立的连接数，可选参数，取值在1-16之间，缺省是1，服务端按文件名把文件分配到各连接上，\n"
+    "              各连接并行下载，适用于网络延时大、一个连接不能充分利用带宽的场景\n"
+    "compress      文件内容的压缩方式，可选参数，none-不压缩，zlib-用zlib压缩后传输，缺省是none，\n"
+    "              适用于带宽有限、文件是文本等容易压缩的场景，*.gz、*.zip等已压缩的文件不会再压缩，\n"
+    "              服务端不支持压缩时自动按不压缩传输\n\n";
 }
 
 bool _xmltoarg(const string& xmlbuffer)
@@ -290,5 +357,14 @@ bool _xmltoarg(const string& xmlbuffer)
 
     getxmlbuffer(xmlbuffer, "pname", starg.pname, 63);
 
+    getxmlbuffer(xmlbuffer, "streams", starg.streams);
+    if (starg.streams < 1) starg.streams = 1;
+    if (starg.streams > 16) starg.streams = 16;
+
+    getxmlbuffer(xmlbuffer, "compress", starg.compress, 10);
+    if (strlen(starg.compress) == 0) strcpy(starg.compress, "none");
+    if ((strcmp(starg.compress, "none") != 0) && (strcmp(starg.compress, "zlib") != 0))
+    { logfile.write("compress must in {none,zlib}\n"); return false; }
+
     return true;
 }
\ No newline at end of file
@@ -22,22 +22,56 @@ struct st_arg
     int timetvl;
     int timeout;
     char pname[64];
+    int streams;        // 与服务端建立的连接数
+    char compress[11];  // 文件内容的压缩方式，none-不压缩，zlib-用zlib压缩
 }starg;
 
 clogfile logfile;       // 日志
 cpactive pactive;       // 进程心跳
-ctcpclient tcpclient;   // tcp客户端
 
-string sendbuffer;      // 发送报文
-string recvbuffer;      // 接收报文
-
-bool login(const char* argv); // 登录函数，向服务端发送本程序的信息（运行参数）
-bool activetest();      // 发送心跳报文的函数
+// 一个上传文件的连接，每个连接由一个线程负责
+struct st_stream
+{
+    int id = 0;             // 连接的编号，从0开始
+    ctcpclient tcpclient;   // tcp客户端
+    csendwindow window;     // 已发送但未收到对端确认报文的文件
+};
 
-void _tcpputfiles();    // 上传文件的主函数 
-bool _sendfiles(bool& bcontinue); // 执行一次发送任务的函数，bcontinue表示本次任务是否发送了文件
-bool sendfile(const string& filename, const int filesize); // 发送一次文件的函数，使用绝对路径
-bool ackmessage(const string& recvbuffer); // 处理确认报文
+// 待上传文件的信息
+struct st_fileinfo
+{
+    string filename;        // 文件名，不包括目录名
+    string ffilename;       // 绝对路径的文件名
+    long filesize;          // 文件的大小
+    string mtime;           // 文件的时间
+};
+
+vector<unique_ptr<st_stream>> vstreams; // 全部的连接
+
+mutex mtx;                      // 保护以下三个变量的互斥锁
+condition_variable cond;        // 有文件入队、文件已确认或有线程退出时通知
+deque<st_fileinfo> fileq;       // 待上传文件的队列，由主线程扫描目录后放入，各连接的线程取出上传
+int pending = 0;                // 已放入队列但还未收到确认报文（或确认超时）的文件数量
+atomic<bool> bexit(false);      // 有连接已不可用或收到了退出信号，全部的线程退出
+volatile sig_atomic_t exitsig = 0; // 收到的退出信号，由信号处理函数设置
+bool bresume = false;           // 服务端是否支持大文件的断点续传，由登录的回应报文确定
+bool bcompress = false;         // 服务端是否同意压缩传输，由登录的回应报文确定
+int protover = 1;               // 与服务端协商的协议版本，1-xml格式的报文，2-二进制格式的报文
+atomic<unsigned int> seq(0);    // 文件信息报文的序号，全部的连接共用
+
+const long RESUMESIZE = 10485760;   // 大于等于10M的文件，发送前与服务端协商断点续传的位置
+const int ACKTIMEOUT = 30;          // 等待确认报文的超时时间，单位：秒，超时认为连接已不可用
+
+bool login(st_stream& stream, const char* argv); // 登录函数，向服务端发送本程序的信息（运行参数）
+bool activetest(st_stream& stream); // 发送心跳报文的函数
+
+void _tcpputfiles();    // 上传文件的主函数，扫描目录，把文件放入队列
+void streammain(st_stream& stream); // 连接的线程主函数，从队列中取出文件上传
+bool sendfile(st_stream& stream, const st_fileinfo& fileinfo); // 发送一个文件的函数，包括文件信息和文件内容
+bool recvack(st_stream& stream, const int itimeout); // 接收并处理一个确认报文，itimeout与ctcpclient::read()相同
+void finishack(st_stream& stream, const string& recvbuffer); // 处理一个确认报文，并更新待确认的文件数量
+bool waitoffset(st_stream& stream, long& offset); // 等待服务端断点续传的回应，期间收到的确认报文照常处理
+bool ackmessage(const string& filename); // 文件上传成功后，删除或备份客户端的文件
 
 void EXIT(int sig);     // 退出函数
 void _help();           // 帮助文档
@@ -69,208 +103,332 @@ int main(int argc, char* argv[])
     // 配置心跳信息
     pactive.addpinfo(starg.timeout, starg.pname);
 
-    // 连接tcp服务端
-    if (tcpclient.connect(starg.ip, starg.port) == false)
+    // 连接tcp服务端并登录，每个连接都要登录
+    for (int i = 0; i < starg.streams; ++i)
     {
-        logfile.write("[connect failed] tcpclient.connect(%s, %d)\n", starg.ip, starg.port);
-        EXIT(-1);
-    }
+        vstreams.emplace_back(new st_stream);
+        st_stream& stream = *vstreams.back();
+        stream.id = i;
 
-    // 登录
-    if (login(argv[2]) == false) 
-    {
-        logfile.write("[login failed]\n");
-        EXIT(-1);
+        if (stream.tcpclient.connect(starg.ip, starg.port) == false)
+        {
+            logfile.write("[connect failed] tcpclient.connect(%s, %d)\n", starg.ip, starg.port);
+            EXIT(-1);
+        }
+
+        if (login(stream, argv[2]) == false) 
+        {
+            logfile.write("[login failed] stream %d\n", i);
+            EXIT(-1);
+        }
     }
-    logfile.write("[login success]\n");
+    logfile.write("[login success] streams=%d, compress=%s, protover=%d\n", starg.streams, bcompress ? "zlib" : "none", protover);
 
     _tcpputfiles();
 
+    // 收到了退出信号，各连接的线程已结束，从main()正常返回，全局对象的析构函数会从共享内存中删除本进程的心跳记录
+    if (exitsig != 0) logfile.write("[process exit] sig=%d\n", (int)exitsig);
+
     return 0;
 }
 
-bool login(const char* argv)
+bool login(st_stream& stream, const char* argv)
 {
+    string sendbuffer;
+    string recvbuffer;
+
     // 向服务端发送登录报文
     // 登录报文包含客户端的类型以及其它服务端所需的信息，这里直接将整个argv[2]传过去更方便
-    sformat(sendbuffer, "%s<clienttype>2</clienttype>", argv);
+    // <protover>告诉服务端本程序支持的最高协议版本
+    sformat(sendbuffer, "%s<clienttype>2</clienttype><protover>%d</protover>", argv, PROTOVER);
 
-    //[Debug] logfile.write("[login] send %s ... ", sendbuffer.c_str());
-    if (tcpclient.write(sendbuffer) == false) 
+    if (stream.tcpclient.write(sendbuffer) == false) 
     {
-        //[Debug] logfile << "failed\n";
         logfile.write("[login: send buffer failed] tcpclient.write(%s)\n", sendbuffer.c_str());
         return false;
     }
-    //[Debug] logfile << "success\n";
 
     // 接收服务端的报文
-    //[Debug] logfile.write("[login] recv ... ");
-    if (tcpclient.read(recvbuffer) == false)
+    if (stream.tcpclient.read(recvbuffer) == false)
     {
-        //[Debug] logfile << "failed\n";
         logfile.write("[login: recv buffer failed] tcpclient.read()\n");
         return false;
     }
-    //[Debug] logfile << "success\n";
 
     if (recvbuffer == "failed") return false;
 
+    // 服务端的回应中有<resume>true</resume>，表示支持大文件的断点续传
+    getxmlbuffer(recvbuffer, "resume", bresume);
+
+    // 登录报文中有<compress>zlib</compress>，服务端同意压缩时会原样返回，旧版本的服务端不返回，不压缩
+    string compress;
+    getxmlbuffer(recvbuffer, "compress", compress);
+    bcompress = (compress == "zlib");
+
+    // 服务端的回应中没有<protover>，表示服务端是旧版本，只能用xml格式的报文
+    protover = 1;
+    getxmlbuffer(recvbuffer, "protover", protover);
+    if ((protover < 1) || (protover > PROTOVER)) protover = 1;
+
     return true;
 }
 
-bool activetest()
+bool activetest(st_stream& stream)
 {
-    sendbuffer = "<activetest>ok</activetest>";
+    string sendbuffer;
+    string recvbuffer;
 
-    //[Debug] logfile.write("[activetest] send %s ... ", sendbuffer.c_str());
-    if (tcpclient.write(sendbuffer) == false)
+    st_filemsg msg;
+    msg.type = FMSG_ACTIVETEST;
+    packfilemsg(msg, sendbuffer, protover);
+
+    if (stream.tcpclient.write(sendbuffer) == false)
     {
-        //[Debug] logfile << "failed\n";
-        logfile.write("[activetest: recv buffer failed] tcpclient.write(%s)\n", sendbuffer.c_str());
+        logfile.write("[activetest: send buffer failed] stream %d tcpclient.write()\n", stream.id);
         return false;
     }
-    //[Debug] logfile << "success\n";
 
     // 接收对端的心跳报文
-    //[Debug] logfile.write("[activetest] recv ... ");
-    if (tcpclient.read(recvbuffer, 20) == false)
+    if (stream.tcpclient.read(recvbuffer, 20) == false)
     {
-        //[Debug] logfile << "failed\n";
-        logfile.write("[activetest: recv buffer failed] tcpclient.read()\n");
+        logfile.write("[activetest: recv buffer failed] stream %d tcpclient.read()\n", stream.id);
         return false;
     }
-    //[Debug] logfile << "success\n";
 
     return true;
 }
 
 void _tcpputfiles()
 {
-    bool bcontinue = true;
+    // 每个连接启动一个线程，从队列中取出文件上传
+    vector<thread> vthreads;
+    for (auto& stream : vstreams)
+        vthreads.emplace_back(streammain, ref(*stream));
 
-    while (true)
+    // 监视客户端的目录，有新文件时立即上传，没有新文件时不必扫描目录
+    cdirwatch watcher;
+    if (watcher.watch(starg.clientpath, starg.matchname, starg.andchild) == false)
+        logfile.write("[_tcpputfiles: watch directory failed] watcher.watch(%s), scan every %d seconds\n", starg.clientpath, starg.timetvl);
+
+    while (bexit == false)
     {
-        if (_sendfiles(bcontinue) == false)
+        // 扫描客户端的目录，把文件放入队列
+        cdir dir;
+        if (dir.opendir(starg.clientpath, starg.matchname, 10000, starg.andchild, false) == false)
         {
-            logfile.write("[_tcpputfiles: send files failed] _sendfiles()\n");
-            return;
+            logfile.write("[_tcpputfiles: open directory failed] dir.opendir(%s)\n", starg.clientpath);
+            bexit = true;
+            break;
         }
 
-        if (bcontinue == false)
-        {
-            sleep(starg.timetvl);
+        // readdir()读完全部的文件后会清空容器，所以文件数要在读取前取出
+        int count = dir.size();
 
-            if (activetest() == false) return;
+        {
+            lock_guard<mutex> lock(mtx);
+            while (dir.readdir())
+                fileq.push_back(st_fileinfo{dir.m_filename, dir.m_ffilename, dir.m_filesize, dir.m_mtime});
+            pending = pending + count;
         }
+        cond.notify_all();
 
         pactive.uptatime();
-    }
-}
 
-bool _sendfiles(bool& bcontinue)
-{
-    bcontinue = false;
+        // 如果没有文件，就等待目录中的新文件，各连接的线程空闲时会发送心跳报文
+        if (count == 0)
+        {
+            while ((bexit == false) && (watcher.wait(starg.timetvl) == false)) pactive.uptatime();
+            continue;
+        }
 
-    cdir dir;
-    if (dir.opendir(starg.clientpath, starg.matchname, 10000, starg.andchild, false) == false)
-    {
-        logfile.write("[_sendfiles: open directory failed] dir.opendir(%s)\n", starg.srvpath);
-        return false;
+        // 等待本次的文件全部上传并收到确认报文，再扫描目录，避免同一个文件被重复上传
+        unique_lock<mutex> lock(mtx);
+        while ((pending > 0) && (bexit == false))
+        {
+            cond.wait_for(lock, chrono::seconds(1));
+            pactive.uptatime();
+        }
     }
 
-    int delayed = 0;
+    cond.notify_all();
+    for (auto& th : vthreads) th.join();
 
-    while (dir.readdir())
-    {
-        bcontinue = true;
+    if (exitsig == 0) logfile.write("[_tcpputfiles: send files failed]\n");
+}
 
-        // 先向对端发送文件信息
-        sendbuffer = sformat("<filename>%s</filename><filesize>%d</filesize><mtime>%s</mtime>", 
-            dir.m_filename.c_str(), dir.m_filesize, dir.m_mtime.c_str());
+void streammain(st_stream& stream)
+{
+    while (bexit == false)
+    {
+        st_fileinfo fileinfo;
+        bool bgot = false;
 
-        //[Debug] logfile.write("[_sendfiles] send %s ... ", sendbuffer.c_str());
-        if (tcpclient.write(sendbuffer) == false)
         {
-            //[Debug] logfile << "failed\n";
-            logfile.write("[_sendfiles: send buffer failed] tcpclient.write(%s)", sendbuffer.c_str());
-            return false;
+            unique_lock<mutex> lock(mtx);
+
+            // 没有文件可发并且没有待确认的文件，最多等待timetvl秒
+            if (fileq.empty() && (stream.window.empty() == true))
+                cond.wait_for(lock, chrono::seconds(starg.timetvl), []{ return (fileq.empty() == false) || (bexit == true); });
+
+            if (fileq.empty() == false)
+            {
+                fileinfo = move(fileq.front());
+                fileq.pop_front();
+                bgot = true;
+            }
         }
-        //[Debug] logfile << "success\n";
 
-        // 再发送文件
-        logfile.write("[_sendfiles] send %s(%d) ... ", dir.m_filename.c_str(), dir.m_filesize);
-        if (sendfile(dir.m_ffilename, dir.m_filesize) == false)
+        if (bexit == true) break;
+
+        if (bgot == true)
         {
-            logfile << "failed\n";
-            return false; 
-        }
-        logfile << "success\n";
-        ++delayed;
+            // 发送窗口已满，等待确认报文
+            bool bok = true;
+            while ((stream.window.full() == true) && (bok == true)) bok = recvack(stream, ACKTIMEOUT);
+            if (bok == false)
+            {
+                logfile.write("[streammain: recv ack failed] stream %d\n", stream.id);
+                break;
+            }
 
-        pactive.uptatime();
+            if (sendfile(stream, fileinfo) == false) break;
 
-        while (delayed > 0)
-        {
             // 接收对端的确认报文，时间设置为-1，表示不等待，如果接收缓冲区没有报文就继续发送文件
-            if (tcpclient.read(recvbuffer, -1) == false) break;
+            while ((stream.window.empty() == false) && (recvack(stream, -1) == true));
+            continue;
+        }
 
-            ackmessage(recvbuffer);
-            --delayed;
+        // 队列中没有文件了，处理剩余的确认报文，每个文件都要确认，超时说明连接已不可用
+        // 程序退出后由调度程序重新启动，未确认的文件还在目录中，会重新上传
+        if (stream.window.empty() == false)
+        {
+            if (recvack(stream, ACKTIMEOUT) == false)
+            {
+                logfile.write("[streammain: recv ack failed] stream %d, %d files not acknowledged\n", 
+                    stream.id, (int)stream.window.size());
+                break;
+            }
+            continue;
         }
+
+        // 空闲了timetvl秒，发送心跳报文
+        if (activetest(stream) == false) break;
+    }
+
+    bexit = true;
+    cond.notify_all();
+}
+
+bool sendfile(st_stream& stream, const st_fileinfo& fileinfo)
+{
+    // 服务端支持断点续传时，大文件要先协商从哪个位置开始发送
+    bool bfileresume = (bresume == true) && (fileinfo.filesize >= RESUMESIZE);
+
+    // 已经是压缩格式的文件再压缩也小不了多少，直接发送
+    bool bfilecompress = (bcompress == true) && (compressible(fileinfo.filename) == true);
+
+    // 先向对端发送文件信息
+    st_filemsg msg;
+    msg.type = FMSG_FILEHEAD;
+    msg.flags = (bfileresume ? FMSG_RESUME : 0) | (bfilecompress ? FMSG_COMPRESS : 0);
+    msg.seq = ++seq;
+    msg.filename = fileinfo.filename;
+    msg.filesize = fileinfo.filesize;
+    msg.mtime = fileinfo.mtime;
+
+    string sendbuffer;
+    if (packfilemsg(msg, sendbuffer, protover) == false)
+    {
+        logfile.write("[sendfile: pack message failed] stream %d packfilemsg(%s)\n", stream.id, fileinfo.filename.c_str());
+        return false;
     }
 
-    // 处理剩余的确认报文
-    while (delayed > 0)
+    if (stream.tcpclient.write(sendbuffer) == false)
     {
-        if (tcpclient.read(recvbuffer, 10) == false) break;
+        logfile.write("[sendfile: send buffer failed] stream %d tcpclient.write(%s)\n", stream.id, fileinfo.filename.c_str());
+        return false;
+    }
+
+    // 等待服务端回应已接收的字节数
+    long offset = 0;
+    if ((bfileresume == true) && (waitoffset(stream, offset) == false)) return false;
 
-        ackmessage(recvbuffer);
-        --delayed;
+    // 再发送文件，压缩传输时边压缩边发送，否则文件的内容由内核直接拷贝到socket，不经过用户空间的缓冲区
+    bool bok = (bfilecompress == true) ? stream.tcpclient.sendfilez(fileinfo.ffilename, fileinfo.filesize, offset)
+                                       : stream.tcpclient.sendfile(fileinfo.ffilename, fileinfo.filesize, offset);
+    if (bok == false)
+    {
+        logfile.write("[sendfile: send file failed] stream %d tcpclient.sendfile(%s, %ld, %ld)\n", 
+            stream.id, fileinfo.ffilename.c_str(), fileinfo.filesize, offset);
+        return false;
     }
 
+    logfile.write("[_sendfiles] send %s(%ld) from %ld ... success\n", fileinfo.filename.c_str(), fileinfo.filesize, offset);
+    stream.window.push(msg.seq, fileinfo.filename, fileinfo.filesize);
+
+    pactive.uptatime();
+
     return true;
 }
 
-bool sendfile(const string& filename, const int filesize)
+bool recvack(st_stream& stream, const int itimeout)
 {
-    int onread = 0;
-    int totalbytes = 0;
-    char buffer[1024];
+    string recvbuffer;
+
+    if (stream.tcpclient.read(recvbuffer, itimeout) == false) return false;
+
+    finishack(stream, recvbuffer);
 
-    cifile ifile;
-    if (ifile.open(filename, ios::in | ios::binary) == false)
+    return true;
+}
+
+void finishack(st_stream& stream, const string& recvbuffer)
+{
+    // 按序号从发送窗口中取出对应的文件，对应不上的确认报文不处理
+    st_filemsg msg;
+    csendwindow::st_inflight item;
+    if ((unpackfilemsg(recvbuffer, msg) == false) || (msg.type != FMSG_ACK) || (stream.window.ack(msg, item) == false))
     {
-        logfile.write("[sendfile: open file failed] ifile.open(%s)\n", filename.c_str());
-        return false;
+        logfile.write("[finishack: unexpected ack] stream %d seq=%u, filename=%s\n", stream.id, msg.seq, msg.filename.c_str());
+        return;
     }
 
-    while (totalbytes < filesize)
+    // 服务端接收失败的文件留在目录中，下次扫描目录时会重新上传
+    if ((msg.flags & FMSG_SUCCESS) != 0) ackmessage(item.filename);
+
     {
-        memset(buffer, 0, sizeof(buffer));
+        lock_guard<mutex> lock(mtx);
+        --pending;
+    }
+    cond.notify_all();
+}
 
-        onread = (filesize - totalbytes) > 1024 ? 1024 : (filesize - totalbytes);
+bool waitoffset(st_stream& stream, long& offset)
+{
+    string recvbuffer;
+    st_filemsg msg;
 
-        ifile.read(buffer, onread);
+    while (true)
+    {
+        if (stream.tcpclient.read(recvbuffer, 30) == false)
+        {
+            logfile.write("[waitoffset: recv buffer failed] stream %d tcpclient.read()\n", stream.id);
+            return false;
+        }
 
-        if (tcpclient.write(buffer, onread) == false) return false;
+        if ((unpackfilemsg(recvbuffer, msg) == true) && (msg.type == FMSG_OFFSET)) break;
 
-        totalbytes += onread;
+        // 前面发送的文件的确认报文
+        finishack(stream, recvbuffer);
     }
 
+    offset = msg.offset;
+
     return true;
 }
 
-bool ackmessage(const string& recvbuffer)
+bool ackmessage(const string& filename)
 {
-    string filename;
-    string result;
-
-    getxmlbuffer(recvbuffer, "filename", filename);
-    getxmlbuffer(recvbuffer, "result", result);
-
-    if (result != "success") return false;
-
     if (starg.ptype == 1)
     {
         string removefile = sformat("%s/%s", starg.clientpath, filename.c_str());
@@ -285,7 +443,7 @@ bool ackmessage(const string& recvbuffer)
     {
         string rscfile = sformat("%s/%s", starg.clientpath, filename.c_str());
         string dstfile = sformat("%s/%s", starg.clientpathbak, filename.c_str());
-        if (rename(rscfile.c_str(), dstfile.c_str()) == false)
+        if (rename(rscfile.c_str(), dstfile.c_str()) != 0)
         {
             logfile.write("[ackmessage: bak file failed] rename(%s, %s)\n", rscfile.c_str(), dstfile.c_str());
             return false;
@@ -297,6 +455,10 @@ bool ackmessage(const string& recvbuffer)
 
 void EXIT(int sig)
 {
+    // 收到信号时只设置退出标志，由主线程通知各连接的线程退出并等待它们结束，再从main()正常返回，
+    // 各连接的线程还在使用全局对象，不能在这里调用exit()
+    if (sig > 0) { exitsig = sig; bexit = true; return; }
+
     logfile.write("[process exit] sig=%d\n", sig);
 
     exit(0);
@@ -328,7 +490,12 @@ void _help()
     "clientpathbak 文件成功上传后，客户端文件备份的根目录，当ptype==2时有效\n"
     "timetvl       扫描客户端目录文件的时间间隔，单位：秒，取值在1-30之间\n"
     "timeout       本程序的超时时间，单位：秒，视文件大小和网络带宽而定，建议设置50以上\n"
-    "pname         进程名，尽可能采用易懂的、与其它进程不同的名称，方便故障排查\n\n";
+    "pname         进程名，尽可能采用易懂的、与其它进程不同的名称，方便故障排查\n"
+    "streams       与服务端建立的连接数，可选参数，取值在1-16之间，缺省是1，文件分配到各连接上并行上传，\n"
+    "              适用于网络延时大、一个连接不能充分利用带宽的场景\n"
+    "compress      文件内容的压缩方式，可选参数，none-不压缩，zlib-用zlib压缩后传输，缺省是none，\n"
+    "              适用于带宽有限、文件是文本等容易压缩的场景，*.gz、*.zip等已压缩的文件不会再压缩，\n"
+    "              服务端不支持压缩时自动按不压缩传输\n\n";
 }
 
 bool _xmltoarg(const string& xmlbuffer)
@@ -373,5 +540,14 @@ bool _xmltoarg(const string& xmlbuffer)
 
     getxmlbuffer(xmlbuffer, "pname", starg.pname, 63);
 
+    getxmlbuffer(xmlbuffer, "streams", starg.streams);
+    if (starg.streams < 1) starg.streams = 1;
+    if (starg.streams > 16) starg.streams = 16;
+
+    getxmlbuffer(xmlbuffer, "compress", starg.compress, 10);
+    if (strlen(starg.compress) == 0) strcpy(starg.compress, "none");
+    if ((strcmp(starg.compress, "none") != 0) && (strcmp(starg.compress, "zlib") != 0))
+    { logfile.write("compress must in {none,zlib}\n"); return false; }
+
     return true;
 }
\ No newline at end of file
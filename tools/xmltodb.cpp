@@ -8,13 +8,21 @@
         2.tname：表名
         3.uptbz：更新标志：1-更新；2-不更新
         4.execsql：数据文件入库之前执行的sql语句
+        5.batchsize：一次提交给数据库的记录数（数组DML），缺省100，取值在1-5000之间
+        6.loadmode：入库方式，insert-先插入，记录已存在时再更新（缺省）；merge-用merge语句一次完成插入或更新；
+          append-先插入临时表，再用直接路径一次插入目标表，适用于先清空表再全量入库的数据
+          直接路径插入只写在表的高水位线之上，不会重用delete释放的空间，execsql要用truncate清空表，
+          用delete清空的话，每次全量入库表都会变大；记录已存在时不会更新，整个文件入库失败，移到错误目录
     正常情况下，一种xml文件（一种匹配规则）应当对应唯一一个数据入库参数
+    指定了threads参数时，多个入库线程同时处理不同的文件，每个线程有自己的数据库连接，
+    同一个表的文件总是交给同一个线程，按文件名的顺序入库
+    除了xml文件，也可以入库dminingoracle生成的二进制格式的文件（后缀为.bin），按字段名与表的字段对应
 */
 
 #include "_tools.h"
 
 // 程序运行的参数
-struct st_arg       
+struct st_arg
 {
     char connstr[128];
     char charset[64];
@@ -25,11 +33,11 @@ struct st_arg
     int timetvl;
     int timeout;
     char pname[64];
+    int threads;        // 入库线程数，缺省1
 }starg;
 
 clogfile logfile;       // 日志
 cpactive pactive;       // 进程心跳
-connection conn;        // 数据库连接
 
 // 数据入库参数的结构体
 struct st_xmltotable
@@ -38,30 +46,105 @@ struct st_xmltotable
     char tname[32];     // 待入库的表名
     int uptbz;          // 更新标志：1-更新；2-不更新
     char execsql[256];  // 处理xml文件之前，执行的SQL语句
+    int batchsize;      // 一次提交给数据库的记录数
+    int loadmode;       // 入库方式：1-insert，记录已存在时再update；2-merge；3-append
 } stxmltotable;
 
 vector<struct st_xmltotable> vxmltotable;   // 存放数据入库的参数
+vector<cmatchstr> vxmlmatch;                // 与vxmltotable一一对应，预先编译好的文件名匹配规则
+
+// 待入库的文件
+struct st_task
+{
+    string ffilename;                       // 绝对路径的文件名
+    string filename;                        // 文件名
+    bool bfound;                            // 是否找到了文件对应的入库参数
+    struct st_xmltotable stxmltotable{};    // 文件对应的入库参数，找不到时为空
+};
+
+// 表的字段信息和准备好的sql语句，缓存在入库线程中
+// 同一个表的文件不必每次都查询数据字典、拼接和准备sql语句，重新加载入库参数或遇到表结构相关的错误时清除
+struct st_table
+{
+    int uptbz;                          // 准备sql语句时的更新标志
+    int batchsize;                      // 准备sql语句时的批量大小，决定了绑定数组的大小
+    int loadmode;                       // 准备sql语句时的入库方式
+    bool bmerge;                        // 是否用merge语句入库，没有主键的表不能merge，仍用insert
+    bool bappend;                       // 是否先插入临时表，再用直接路径插入目标表
+    bool binvalid;                      // 执行sql时遇到了表结构相关的错误，下一个文件需要重新获取
+
+    ctcols tcols;                       // 用于获取表的字段和主键
+
+    string insertsql;                   // 插入表的SQL语句，merge方式时是merge语句，绑定变量的顺序与插入语句相同
+    string updatesql;                   // 更新表的SQL语句
+    vector<string> vcolvalue;           // 存放一条记录的字段的值，用于更新表的SQL语句绑定变量
+    vector<string> vcolarray;           // 存放一批记录的字段的值，每个字段一个数组，用于插入表的SQL语句绑定变量
+    sqlstatement stmtins, stmtupt;      // 插入（或merge）和更新表的sqlstatement语句
+    string appendsql;                   // append方式下把临时表的记录插入目标表的SQL语句
+    sqlstatement stmtapp;               // append方式下把临时表的记录插入目标表的sqlstatement语句
+};
+
+// 入库线程，每个线程有自己的数据库连接、sql语句和绑定变量，互不干扰
+// 单线程运行时只有一个入库线程，在主线程中直接处理文件
+struct st_worker
+{
+    int id;                             // 线程的编号，从0开始
+    string name;                        // 写日志用的名称，单线程时为空
+    thread th;                          // 线程对象
+    deque<st_task> tasks;               // 待处理的文件队列，最多MAXTASKS个
+
+    connection conn;                    // 数据库连接
+    struct st_xmltotable stxmltotable;  // 正在处理的文件的入库参数
+
+    ctimer timer;                       // 处理每个xml文件消耗的时间
+    int totalcount, inscount, uptcount; // xml文件的总记录数、插入记录数和更新记录数
+
+    map<string, unique_ptr<st_table>> tables; // 表名与缓存的表结构和sql语句
+    st_table* table;                    // 正在入库的表
+    vector<string> vretry;              // 本轮扫描中表结构已改变的表，为了保证按文件名的顺序入库，这些表剩下的文件也留到下一轮
+
+    vector<pair<const char*, int>> vxmlbuffer; // 一批记录的xml在文件映射区中的地址和长度，记录入库失败时写日志用，二进制格式的文件为空
+    vector<int> vbinfield;              // 二进制格式的文件中，表的每个字段在文件中的序号，-1表示文件中没有这个字段
+    sqlstatement stmtpre;               // 文件入库前执行的sql
+    cxmlrecord record;                  // 解析xml记录
+
+    // 本轮扫描的统计信息
+    int files;                          // 处理的文件数
+    long rows, inserts, updates;        // 总记录数、插入记录数和更新记录数
+    double elapsed;                     // 处理文件消耗的时间，单位：秒
+};
+
+const int MAXTASKS = 10;                // 每个入库线程的队列中最多存放的文件数
+vector<unique_ptr<st_worker>> vworkers; // 入库线程
+mutex mtx;                              // 保护以下变量和各线程的队列
+condition_variable cond;                // 队列、pending和bfatal变化时通知
+int pending = 0;                        // 已分配但还未处理完的文件数
+int donecount = 0;                      // 已处理完的文件数，主线程据此更新心跳
+bool bfatal = false;                    // 入库线程遇到了数据库错误等致命的错误
+bool bstop = false;                     // 通知入库线程退出
+volatile sig_atomic_t exitsig = 0;      // 收到的退出信号，由信号处理函数设置，主线程发现后通知入库线程退出
 
 bool loadxmltotable();  // 从inifile中将入库参数加载到vxmltotable中
 bool _xmltodb();        // 数据入库的主函数
-int _xmltodb(const string& fullfilename,const string& filename); // 处理xml文件的子函数，返回值：0-成功
+int _xmltodb(st_worker& w, const st_task& task); // 处理xml文件的子函数，返回值：0-成功
+bool processfile(st_worker& w, const st_task& task); // 处理一个xml文件并把它移到备份或错误目录，返回false表示程序需要退出
+void workermain(st_worker& w);  // 入库线程的主函数
+bool dispatch(st_task& task);   // 把文件分配给负责该表的入库线程，队列满时等待
+bool waitworkers();             // 等待已分配的文件全部处理完，返回false表示有入库线程遇到了致命的错误
+void stopworkers();             // 通知入库线程退出并等待它们结束
 bool findxmltotable(const string& xmlfile); // 根据文件名，从vxmltotable容器中查找的入库参数，存放在stxmltotable结构体中
 
-ctimer timer;                       // 处理每个xml文件消耗的时间
-int totalcount, inscount, uptcount; // xml文件的总记录数、插入记录数和更新记录数
-
-ctcols tcols;                       // 用于获取表的字段和主键
-
-string insertsql;                   // 插入表的SQL语句
-string updatesql;                   // 更新表的SQL语句
-vector<string> vcolvalue;           // 存放从xml每一行中解析出来的字段的值，将用于插入和更新表的SQL语句绑定变量
-sqlstatement stmtins, stmtupt;      // 插入和更新表的sqlstatement语句
-sqlstatement stmtpre;               // 文件入库前执行的sql 
-
-void crtsql();          // 拼接插入和更新表数据的SQL
-void preparesql();      // 准备插入和更新的sql语句，绑定输入变量
-bool execsql();         // 在处理xml文件之前，如果stxmltotable.execsql不为空，就执行它
-void splitbuffer(const string& xmlbuffer); // 解析xml，存放在vcolvalue中
+void crtsql(st_worker& w);      // 拼接插入和更新表数据的SQL
+void crtmergesql(st_worker& w); // 拼接merge语句，存放在insertsql中
+bool crtstagetable(st_worker& w); // append方式下，如果临时表不存在，创建它
+void preparesql(st_worker& w);  // 准备插入和更新的sql语句，绑定输入变量
+bool execsql(st_worker& w);     // 在处理xml文件之前，如果stxmltotable.execsql不为空，就执行它
+void splitbuffer(st_worker& w, const char* xmlbuffer, const size_t len, const int row); // 解析xml，存放在vcolarray的第row条记录中
+void splitrecord(st_worker& w, const cbinreader& bfile, const int row); // 把二进制格式的文件的当前记录存放在vcolarray的第row条记录中
+void setvalue(const char* datatype, const int collen, char* value, const char* field, const size_t fieldlen); // 把字段的内容按字段的类型和长度复制到绑定的数组中
+string recordtext(st_worker& w, const int row); // 一批记录中第row条记录的内容，写日志用
+int execbatch(st_worker& w, const int rows); // 执行一批记录的插入，违反唯一性约束的记录改为更新，返回值：0-成功；2-数据库错误；8-表结构已改变
+bool ddlerror(const int rc);    // 判断sql语句的错误是否与表结构有关，是则需要清除表的缓存
 
 void EXIT(int sig);     // 退出函数
 void _help();           // 帮助文档
@@ -96,12 +179,16 @@ int main(int argc, char* argv[])
 
     _xmltodb();
 
+    // 收到了退出信号，入库线程已结束，从main()正常返回，全局对象的析构函数会从共享内存中删除本进程的心跳记录
+    if (exitsig != 0) logfile.write("[process exit] sig=%d\n", (int)exitsig);
+
     return 0;
 }
 
 bool loadxmltotable()
 {
     vxmltotable.clear();
+    vxmlmatch.clear();
 
     cifile ifile;
     if (ifile.open(starg.inifilename) == false)
@@ -120,8 +207,19 @@ bool loadxmltotable()
         getxmlbuffer(buffer, "tname", stxmltotable.tname);
         getxmlbuffer(buffer, "uptbz", stxmltotable.uptbz);
         getxmlbuffer(buffer, "execsql", stxmltotable.execsql);
+        getxmlbuffer(buffer, "batchsize", stxmltotable.batchsize);
+        if (stxmltotable.batchsize == 0) stxmltotable.batchsize = 100;
+        if (stxmltotable.batchsize < 1) stxmltotable.batchsize = 1;
+        if (stxmltotable.batchsize > 5000) stxmltotable.batchsize = 5000;
+
+        char loadmode[11] = {0};
+        getxmlbuffer(buffer, "loadmode", loadmode, 10);
+        stxmltotable.loadmode = 1;
+        if (strcmp(loadmode, "merge") == 0)  stxmltotable.loadmode = 2;
+        if (strcmp(loadmode, "append") == 0) stxmltotable.loadmode = 3;
 
         vxmltotable.push_back(stxmltotable);
+        vxmlmatch.emplace_back(stxmltotable.filename);
     }
     logfile.write("[load xmltotable success]\n");
 
@@ -133,93 +231,116 @@ bool _xmltodb()
     cdir dir;
     int inicount = 50;
 
+    // 创建入库线程的数据，单线程时不启动线程，在主线程中处理文件
+    for (int ii = 0; ii < starg.threads; ii++)
+    {
+        vworkers.emplace_back(new st_worker);
+        vworkers[ii]->id = ii;
+        if (starg.threads > 1) vworkers[ii]->name = sformat("worker %d ", ii);
+    }
+
+    if (starg.threads > 1)
+    {
+        for (auto& w : vworkers)
+            w->th = thread(workermain, ref(*w));
+    }
+
+    // 监视xml文件的目录，有新文件时立即入库，没有新文件时不必扫描目录
+    cdirwatch watcher;
+    if (watcher.watch(starg.xmlpath, "*.XML,*.BIN") == false)
+        logfile.write("[_xmltodb: watch directory failed] watcher.watch(%s), scan every %d seconds\n", starg.xmlpath, starg.timetvl);
+
     while (true)
     {
+        // 收到了退出信号，通知入库线程退出并等待它们结束
+        if (exitsig != 0) { stopworkers(); return true; }
+
         // 本程序常驻内存，需要定时加载参数，因为inifile随时可能被修改
+        // 上一轮的文件已全部处理完，入库线程不会再读取入库参数
         if (++inicount > 30)
         {
-            if (loadxmltotable() == false) return false;
+            if (loadxmltotable() == false) { stopworkers(); return false; }
+
+            // 入库参数或表结构可能被修改了，清除各入库线程缓存的表结构和sql语句
+            for (auto& w : vworkers) w->tables.clear();
 
             inicount = 0;
         }
 
         // 打开starg.xmlpath目录，为了保证先生成的xml文件先入库，打开目录的时候，应该按文件名排序。
-        if (dir.opendir(starg.xmlpath, "*.XML", 10000, false, true) == false)
+        if (dir.opendir(starg.xmlpath, "*.XML,*.BIN", 10000, false, true) == false)
         {
-            logfile.write("[_xmltodb: open directory failed] dir.opendir(%s)\n",starg.xmlpath); 
-            return false;
+            logfile.write("[_xmltodb: open directory failed] dir.opendir(%s)\n",starg.xmlpath);
+            stopworkers(); return false;
         }
-        
-        if (conn.isopen() == false)
+
+        for (auto& w : vworkers)
         {
-            if (conn.connecttodb(starg.connstr, starg.charset) != 0)
+            if (w->conn.isopen() == false)
             {
-                logfile.write("[connect to database failed] conn.connecttodb(%s, %s)\n", starg.connstr, starg.charset);
-                EXIT(-1);
+                if (w->conn.connecttodb(starg.connstr, starg.charset) != 0)
+                {
+                    logfile.write("[connect to database failed] conn.connecttodb(%s, %s)\n", starg.connstr, starg.charset);
+                    stopworkers(); EXIT(-1);
+                }
+                logfile.write("[%sconnect to database(%s) success]\n", w->name.c_str(), starg.connstr);
             }
-            logfile.write("[connect to database(%s) success]\n", starg.connstr);
-        } 
+
+            w->files = 0; w->rows = w->inserts = w->updates = 0; w->elapsed = 0;
+            w->vretry.clear();
+        }
+
+        // readdir()读完全部的文件后会清空容器，所以文件数要在读取前取出
+        int count = dir.size();
 
         while (dir.readdir())
-        {   
-            logfile.write("[_xmltodb] process file(%s) ... ", dir.m_ffilename.c_str());
+        {
+            // 收到了退出信号，剩下的文件不再处理
+            if (exitsig != 0) break;
 
-            int ret=_xmltodb(dir.m_ffilename,dir.m_filename);
+            st_task task;
+            task.ffilename = dir.m_ffilename;
+            task.filename = dir.m_filename;
 
-            pactive.uptatime();   // 更新进程的心跳
+            // 找到文件对应的入库参数
+            task.bfound = findxmltotable(dir.m_filename);
+            if (task.bfound == true) task.stxmltotable = stxmltotable;
 
-            if (ret == 0) // 文件入库成功，将其移至备份目录
+            if (starg.threads == 1)
             {
-                string bakfile = sformat("%s/%s", starg.xmlpathbak, dir.m_filename.c_str());
-                // 备份文件一般不会失败，如果失败了，程序将退出
-                if (rename(dir.m_ffilename.c_str(), bakfile.c_str()) != 0) 
-                {
-                    logfile << sformat("failed, bak file(%s, %s) failed\n", 
-                        dir.m_ffilename.c_str(), bakfile.c_str());
-                    return false;
-                }
-                logfile << sformat("success(total: %d, insert: %d, update: %d, failed: %d, time: %f)\n", 
-                    totalcount, inscount, uptcount, totalcount - inscount - uptcount, timer.elapsed());
-            }
+                bool ret = processfile(*vworkers[0], task);
 
-            // 1-入库参数不正确；3-待入库的表不存在；4-执行入库前的SQL语句失败
-            // 把xml文件移动到错误目录
-            if ((ret == 1) || (ret == 3) || (ret == 4))
-            {
-                if (ret == 1) logfile << "failed, incorrect xmltotable\n";
-                if (ret == 3) logfile << "failed, table not exist\n";
-                if (ret == 4) 
-                {
-                    logfile << sformat("failed, execute previous sql failed\nsql: %s\nerror: %s\n", 
-                        stmtpre.sql(), stmtpre.message());
-                }
+                pactive.uptatime();   // 更新进程的心跳
 
-                string errfile = sformat("%s/%s", starg.xmlpatherr, dir.m_filename.c_str());
-                 if (rename(dir.m_ffilename.c_str(), errfile.c_str()) != 0)
-                {
-                    logfile.write("[_xmltodb: move file to error directory failed] rename(%s, %s)\n", 
-                        dir.m_ffilename.c_str(), errfile.c_str());
-                    return false;
-                }
-            }
+                if (ret == false) return false;
 
-            // 2-数据库错误，程序将退出
-            if (ret == 2)
-            {
-                logfile << "failed, database error\n";  
-                return false;
+                continue;
             }
 
-            // 5-打开xml文件失败，程序将退出
-            if (ret == 5)
+            if (dispatch(task) == false) { stopworkers(); return false; }
+        }
+
+        // 下一轮扫描目录之前，本轮的文件必须全部处理完，否则同一个文件会被分配两次
+        if (starg.threads > 1)
+        {
+            if (waitworkers() == false) { stopworkers(); return false; }
+
+            // 各入库线程本轮的统计信息
+            for (auto& w : vworkers)
             {
-                logfile << sformat("failed, open file(%s) failed\n", dir.m_filename); 
-                return false;
+                if (w->files == 0) continue;
+
+                logfile.write("[_xmltodb] %sfiles: %d, total: %ld, insert: %ld, update: %ld, time: %.2fsec, %.0f rows/sec\n",
+                    w->name.c_str(), w->files, w->rows, w->inserts, w->updates, w->elapsed,
+                    w->elapsed > 0 ? w->rows / w->elapsed : 0.0);
             }
         }
 
-        // 刚刚处理了文件，就继续处理，否则程序休眠
-        if (dir.size() == 0) sleep(starg.timetvl);
+        // 刚刚处理了文件，就继续处理，否则等待目录中的新文件
+        if (count == 0)
+        {
+            while ((exitsig == 0) && (watcher.wait(starg.timetvl) == false)) pactive.uptatime();
+        }
 
         pactive.uptatime();   // 更新进程的心跳
     }
@@ -227,94 +348,352 @@ bool _xmltodb()
     return true;
 }
 
-int _xmltodb(const string& fullfilename,const string& filename)
+bool processfile(st_worker& w, const st_task& task)
 {
-    timer.start();
-    totalcount = inscount = uptcount = 0;
+    // 多个线程同时写日志，一个文件的日志只写一次，避免交错
+    string strlog = sformat("[_xmltodb] %sprocess file(%s) ... ", w.name.c_str(), task.ffilename.c_str());
 
-    // 找到文件对应的入库参数，如果没有返回1
-    if (findxmltotable(filename) == false) return 1;
+    // 同一个表前面的文件要重新入库，本文件留在xmlpath中，下一轮再处理
+    if ((task.bfound == true) &&
+        (find(w.vretry.begin(), w.vretry.end(), task.stxmltotable.tname) != w.vretry.end())) return true;
 
-    // 获取字段和主键，失败返回2，失败原因为数据库系统有问题，或网络断开，或连接超时
-    if (tcols.allcols(conn, stxmltotable.tname) == false) return 2;
-    if (tcols.pkcols(conn, stxmltotable.tname) == false)  return 2;
+    int ret = _xmltodb(w, task);
+
+    if (ret == 0) // 文件入库成功，将其移至备份目录
+    {
+        double elapsed = w.timer.elapsed();
+        w.files++; w.rows += w.totalcount; w.inserts += w.inscount; w.updates += w.uptcount; w.elapsed += elapsed;
+
+        string bakfile = sformat("%s/%s", starg.xmlpathbak, task.filename.c_str());
+        // 备份文件一般不会失败，如果失败了，程序将退出
+        if (rename(task.ffilename.c_str(), bakfile.c_str()) != 0)
+        {
+            logfile.write("%sfailed, bak file(%s, %s) failed\n", strlog.c_str(),
+                task.ffilename.c_str(), bakfile.c_str());
+            return false;
+        }
+        logfile.write("%ssuccess(total: %d, insert: %d, update: %d, failed: %d, time: %.2fsec, %.0f rows/sec)\n", strlog.c_str(),
+            w.totalcount, w.inscount, w.uptcount, w.totalcount - w.inscount - w.uptcount, elapsed,
+            elapsed > 0 ? w.totalcount / elapsed : 0.0);
+    }
 
-    // 如果tcols.m_vallcols.size()为0，说明表根本不存在（配错了参数或忘了建表），返回3
-    if (tcols.m_vallcols.size() == 0) return 3;
+    // 1-入库参数不正确；3-待入库的表不存在；4-执行入库前的SQL语句失败；6-append方式插入目标表失败；
+    // 7-二进制格式的文件不正确；9-表结构与文件不匹配
+    // 把xml文件移动到错误目录
+    if ((ret == 1) || (ret == 3) || (ret == 4) || (ret == 6) || (ret == 7) || (ret == 9))
+    {
+        if (ret == 1) logfile.write("%sfailed, incorrect xmltotable\n", strlog.c_str());
+        if (ret == 9) logfile.write("%sfailed, table structure mismatch\n", strlog.c_str());
+        if (ret == 6)
+        {
+            logfile.write("%sfailed, append into table failed\nsql: %s\nerror: %s\n", strlog.c_str(),
+                w.table->stmtapp.sql(), w.table->stmtapp.message());
+        }
+        if (ret == 7) logfile.write("%sfailed, incorrect binary file\n", strlog.c_str());
+        if (ret == 3) logfile.write("%sfailed, table not exist\n", strlog.c_str());
+        if (ret == 4)
+        {
+            logfile.write("%sfailed, execute previous sql failed\nsql: %s\nerror: %s\n", strlog.c_str(),
+                w.stmtpre.sql(), w.stmtpre.message());
+        }
 
-    // 拼接sql语句
-    crtsql();
+        string errfile = sformat("%s/%s", starg.xmlpatherr, task.filename.c_str());
+        if (rename(task.ffilename.c_str(), errfile.c_str()) != 0)
+        {
+            logfile.write("[_xmltodb: move file to error directory failed] rename(%s, %s)\n",
+                task.ffilename.c_str(), errfile.c_str());
+            return false;
+        }
+    }
 
-    // 准备sql对象
-    preparesql();
+    // 8-表结构已改变，文件留在xmlpath中，下次扫描时重新获取表结构再入库
+    if (ret == 8)
+    {
+        logfile.write("%sfailed, table structure changed, retry later\n", strlog.c_str());
+        w.vretry.push_back(task.stxmltotable.tname);
+    }
+
+    // 2-数据库错误，程序将退出
+    if (ret == 2)
+    {
+        logfile.write("%sfailed, database error\n", strlog.c_str());
+        return false;
+    }
+
+    // 5-打开xml文件失败，程序将退出
+    if (ret == 5)
+    {
+        logfile.write("%sfailed, open file(%s) failed\n", strlog.c_str(), task.filename.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+void workermain(st_worker& w)
+{
+    while (true)
+    {
+        st_task task;
+        {
+            unique_lock<mutex> lock(mtx);
+            cond.wait(lock, [&] { return (w.tasks.empty() == false) || (bstop == true); });
+
+            if (bstop == true) break;
+
+            task = std::move(w.tasks.front());
+            w.tasks.pop_front();
+        }
+        cond.notify_all();  // 队列有了空位，通知分配文件的主线程
+
+        bool ret = processfile(w, task);
+
+        {
+            lock_guard<mutex> lock(mtx);
+            --pending;
+            ++donecount;
+            if (ret == false) bfatal = true;
+        }
+        cond.notify_all();
+    }
+}
+
+bool dispatch(st_task& task)
+{
+    // 同一个表的文件总是交给同一个线程，保证按文件名的顺序入库
+    // 没有入库参数的文件，表名为空，也交给固定的线程
+    st_worker& w = *vworkers[hash<string>()(task.stxmltotable.tname) % vworkers.size()];
+
+    unique_lock<mutex> lock(mtx);
+
+    // 队列满了就等待，同时更新心跳
+    int lastdone = donecount;
+    while ((w.tasks.size() >= MAXTASKS) && (bfatal == false) && (exitsig == 0))
+    {
+        cond.wait_for(lock, chrono::seconds(1));
+        if (donecount != lastdone) { lastdone = donecount; pactive.uptatime(); }
+    }
+
+    if ((bfatal == true) || (exitsig != 0)) return false;
+
+    w.tasks.push_back(std::move(task));
+    ++pending;
+
+    lock.unlock();
+    cond.notify_all();
+
+    return true;
+}
+
+bool waitworkers()
+{
+    unique_lock<mutex> lock(mtx);
+
+    // 有文件处理完才更新心跳，如果某个文件长时间处理不完，进程会因为心跳超时被重启，与单线程相同
+    int lastdone = donecount;
+    while ((pending > 0) && (bfatal == false) && (exitsig == 0))
+    {
+        cond.wait_for(lock, chrono::seconds(1));
+        if (donecount != lastdone) { lastdone = donecount; pactive.uptatime(); }
+    }
+
+    return (bfatal == false) && (exitsig == 0);
+}
+
+void stopworkers()
+{
+    {
+        lock_guard<mutex> lock(mtx);
+        bstop = true;
+    }
+    cond.notify_all();
+
+    for (auto& w : vworkers)
+        if (w->th.joinable()) w->th.join();
+}
+
+int _xmltodb(st_worker& w, const st_task& task)
+{
+    w.timer.start();
+    w.totalcount = w.inscount = w.uptcount = 0;
+
+    // 找到文件对应的入库参数，如果没有返回1
+    if (task.bfound == false) return 1;
+    w.stxmltotable = task.stxmltotable;
+
+    // 表的字段和sql语句已缓存，并且入库参数没有变化，直接使用
+    bool bcached = false;
+    auto it = w.tables.find(w.stxmltotable.tname);
+    if ((it != w.tables.end()) && (it->second->binvalid == false) &&
+        (it->second->uptbz == w.stxmltotable.uptbz) && (it->second->batchsize == w.stxmltotable.batchsize) &&
+        (it->second->loadmode == w.stxmltotable.loadmode))
+    {
+        w.table = it->second.get();
+        bcached = true;
+    }
+    else
+    {
+        unique_ptr<st_table> table(new st_table);
+        table->uptbz = w.stxmltotable.uptbz;
+        table->batchsize = w.stxmltotable.batchsize;
+        table->loadmode = w.stxmltotable.loadmode;
+        table->binvalid = false;
+        w.table = table.get();
+
+        // 获取字段和主键，失败返回2，失败原因为数据库系统有问题，或网络断开，或连接超时
+        if (w.table->tcols.allcols(w.conn, w.stxmltotable.tname) == false) return 2;
+        if (w.table->tcols.pkcols(w.conn, w.stxmltotable.tname) == false)  return 2;
+
+        // 如果tcols.m_vallcols.size()为0，说明表根本不存在（配错了参数或忘了建表），返回3
+        // 不存在的表不缓存，建表之后就可以入库
+        if (w.table->tcols.m_vallcols.size() == 0) return 3;
+
+        // merge语句用主键关联记录，没有主键的表只能用insert方式
+        // keyid的值取自序列，不能用于关联
+        int pkcount = 0;
+        for (auto& e : w.table->tcols.m_vpkcols)
+            if ((strcmp(e.colname, "keyid") != 0) && (strcmp(e.colname, "upttime") != 0)) ++pkcount;
+        w.table->bmerge = (w.stxmltotable.loadmode == 2) && (pkcount > 0);
+        if ((w.stxmltotable.loadmode == 2) && (w.table->bmerge == false))
+            logfile.write("[_xmltodb] table %s has no primary key, loadmode merge is ignored\n", w.stxmltotable.tname);
+
+        // append方式需要临时表，创建失败时仍用insert方式
+        // 建表是DDL，会提交事务，所以必须在execsql()之前
+        w.table->bappend = (w.stxmltotable.loadmode == 3) && (crtstagetable(w) == true);
+
+        // 拼接sql语句
+        crtsql(w);
+
+        // 准备sql对象
+        preparesql(w);
+
+        w.tables[w.stxmltotable.tname] = std::move(table);
+    }
+    w.vxmlbuffer.resize(w.stxmltotable.batchsize);
 
     // 在处理xml文件之前，如果stxmltotable.execsql不为空，就执行它
     // 如果执行失败，返回4
-    if (execsql() == false) return 4;
+    if (execsql(w) == false) return 4;
+
+    // 后缀为.bin的文件是dminingoracle生成的二进制格式的文件，其它的是xml文件
+    bool bbinary = matchstr(task.filename, "*.BIN");
 
     // 打开xml文件，如果失败，返回5
-    cifile ifile;
-    if (ifile.open(fullfilename) == false) 
+    // 文件被映射到内存中，记录直接从映射区解析，不需要复制
+    cmmapfile ifile;
+    cbinreader bfile;
+    if ((bbinary == false) && (ifile.open(task.ffilename) == false))
     {
-        conn.rollback(); // 打开文件失败，需要回滚execsql()的事务
+        w.conn.rollback(); // 打开文件失败，需要回滚execsql()的事务
         return 5;
     }
 
-    string xmlbuffer;
-    while (ifile.readline(xmlbuffer, "<endl/>"))
+    // 二进制格式的文件，文件头不正确返回7，找出表的每个字段在文件中的序号
+    if (bbinary == true)
     {
-        ++totalcount;           // xml文件的总记录数加1
+        if (bfile.open(task.ffilename) == false) { w.conn.rollback(); return 7; }
 
-        splitbuffer(xmlbuffer); // 解析xml的值到vcolvalue中
+        w.vbinfield.resize(w.table->tcols.m_vallcols.size());
+        for (int i = 0; i < w.table->tcols.m_vallcols.size(); ++i)
+            w.vbinfield[i] = bfile.findfield(w.table->tcols.m_vallcols[i].colname);
+    }
 
-        // 执行插入语句
-        if (stmtins.execute() != 0)
+    // 每读取batchsize条记录，执行一次插入，减少与数据库的网络往返
+    const char* xmlbuffer;
+    size_t len;
+    int rows = 0;           // 本批次已解析的记录数
+    int iret = 0;           // execbatch()的返回值
+    while (true)
+    {
+        if (bbinary == true)
         {
-            if (stmtins.rc() == 1) // 违反唯一性约束，表示记录已存在，执行更新语句
+            if (bfile.next() == false) break;
+
+            splitrecord(w, bfile, rows); // 把记录的值复制到vcolarray的第rows条记录中
+            w.vxmlbuffer[rows++] = make_pair(nullptr, 0);
+        }
+        else
+        {
+            if (ifile.readrecord(xmlbuffer, len, "<endl/>") == false) break;
+
+            splitbuffer(w, xmlbuffer, len, rows); // 解析xml的值到vcolarray的第rows条记录中
+            w.vxmlbuffer[rows++] = make_pair(xmlbuffer, (int)len);
+        }
+
+        ++w.totalcount;           // xml文件的总记录数加1
+
+        if (rows < w.stxmltotable.batchsize) continue;
+
+        if ((iret = execbatch(w, rows)) != 0) break;
+        rows = 0;
+    }
+
+    // 处理最后一批不足batchsize的记录
+    if ((iret == 0) && (rows > 0)) iret = execbatch(w, rows);
+
+    if (iret == 2) return 2;
+
+    // 表结构已改变，已入库的记录全部回滚
+    // 用的是缓存的表结构，返回8，文件留在xmlpath中，下次扫描时用重新获取的表结构入库；
+    // 用的是刚获取的表结构，说明表结构与文件不匹配，重试也没用，返回9
+    if (iret == 8)
+    {
+        w.conn.rollback();
+        return (bcached == true) ? 8 : 9;
+    }
+
+    // 二进制格式的文件不完整或者已损坏，已入库的记录全部回滚，返回7
+    if ((bbinary == true) && (bfile.good() == false))
+    {
+        w.conn.rollback();
+        return 7;
+    }
+
+    // append方式，把临时表中的记录用直接路径一次插入目标表，失败返回6
+    if (w.table->bappend == true)
+    {
+        if (w.table->stmtapp.execute() != 0)
+        {
+            // 数据库系统的问题返回2，与execbatch()相同
+            if ((w.table->stmtapp.rc() == 3113) ||
+                (w.table->stmtapp.rc() == 3114) ||
+                (w.table->stmtapp.rc() == 3135) ||
+                (w.table->stmtapp.rc() == 16014))
             {
-                if (stxmltotable.uptbz == 1)
-                {
-                    if (stmtupt.execute() != 0)
-                    {
-                        // 更新语句失败，主要是数据本身有问题，例如时间的格式不正确、数值不合法、数值太大
-                        // 记录日志，但不返回失败
-                        logfile.write("[_xmltodb: execute update sql failed]\nxml: %s\nsql: %S\nerror: %s\n", 
-                            xmlbuffer.c_str(), stmtupt.sql(), stmtupt.message());
-                    }
-                    else ++uptcount; // 更新的记录数加1
-                }
+                logfile.write("[_xmltodb: execute append sql failed]\nsql: %s\nerror: %s\n",
+                    w.table->stmtapp.sql(), w.table->stmtapp.message());
+                return 2;
             }
-            else
+
+            w.conn.rollback();
+
+            // 表结构已改变，与execbatch()的处理方法相同
+            if (ddlerror(w.table->stmtapp.rc()) == true)
             {
-                // 插入语句失败，记录日志
-                // 如果是数据本身的问题，则不返回失败
-                logfile.write("[_xmltodb: execute insert sql failed]\nxml: %s\nsql: %S\nerror: %s\n", 
-                            xmlbuffer.c_str(), stmtins.sql(), stmtins.message());
-
-                // 如果是数据库系统出了问题，常见的问题如下，还可能有更多的错误，如果出现了，再加进来
-                // ORA-03113: 通信通道的文件结尾；ORA-03114: 未连接到ORACLE；ORA-03135: 连接失去联系；ORA-16014：归档失败
-                if ((stmtins.rc() == 3113) ||
-                    (stmtins.rc() == 3114) ||
-                    (stmtins.rc() == 3135) ||
-                    (stmtins.rc() == 16014)) 
-                    return 2;
+                logfile.write("[_xmltodb: execute append sql failed]\nsql: %s\nerror: %s\n",
+                    w.table->stmtapp.sql(), w.table->stmtapp.message());
+                w.table->binvalid = true;
+                return (bcached == true) ? 8 : 9;
             }
+
+            return 6;
         }
-        else ++inscount; // 插入的记录数加1
+
+        w.inscount = w.table->stmtapp.rpc();
     }
 
-    conn.commit();
+    w.conn.commit();
 
     return 0;
 }
 
 bool findxmltotable(const string& xmlfile)
 {
-    for (auto& e : vxmltotable)
+    for (size_t ii = 0; ii < vxmltotable.size(); ii++)
     {
-        if (matchstr(xmlfile, e.filename))
+        if (vxmlmatch[ii].match(xmlfile))
         {
-            stxmltotable = e;
+            stxmltotable = vxmltotable[ii];
             return true;
         }
     }
@@ -322,8 +701,11 @@ bool findxmltotable(const string& xmlfile)
     return false;
 }
 
-void crtsql()
+void crtsql(st_worker& w)
 {   
+    // merge方式只需要一条merge语句
+    if (w.table->bmerge == true) { crtmergesql(w); return; }
+
     // 拼接插入表的SQL语句。 
     // insert into T_ZHOBTMIND1(obtid,ddatetime,t,p,u,wd,wf,r,vis,keyid) \
              values(:1,to_date(:2,'yyyymmddhh24miss'),:3,:4,:5,:6,:7,:8,:9,SEQ_ZHOBTMIND1.nextval)
@@ -331,7 +713,7 @@ void crtsql()
     string binds;       // 绑定部分的字符串
     int colseq = 1;     // 绑定的序号
 
-    for (auto& e : tcols.m_vallcols)
+    for (auto& e : w.table->tcols.m_vallcols)
     {
         // upttime字段的缺省值是sysdate，不需要处理
         if (strcmp(e.colname,"upttime") == 0) continue;
@@ -342,7 +724,7 @@ void crtsql()
         if (strcmp(e.colname,"keyid") == 0)
         {
             // keyid为递增字段，名称固定为SEQ_表名（除去开头的两个字符"T_"），值固定为nextval
-            binds += sformat("SEQ_%s.nextval,", stxmltotable.tname + 2);
+            binds += sformat("SEQ_%s.nextval,", w.stxmltotable.tname + 2);
         }
         else if (strcmp(e.datatype,"date") == 0)
         {
@@ -358,11 +740,21 @@ void crtsql()
     deleterchr(cols, ','); // 删除最后一个逗号
     deleterchr(binds, ','); // 删除最后一个逗号
 
-    insertsql = sformat("insert into %s(%s) values(%s)", 
-        stxmltotable.tname, cols.c_str(), binds.c_str());
+    // append方式先插入临时表，全部记录插入后，再用直接路径一次插入目标表
+    if (w.table->bappend == true)
+    {
+        w.table->insertsql = sformat("insert into STG_%s(%s) values(%s)",
+            w.stxmltotable.tname + 2, cols.c_str(), binds.c_str());
+        w.table->appendsql = sformat("insert /*+ APPEND */ into %s(%s) select %s from STG_%s",
+            w.stxmltotable.tname, cols.c_str(), cols.c_str(), w.stxmltotable.tname + 2);
+        return;
+    }
+
+    w.table->insertsql = sformat("insert into %s(%s) values(%s)", 
+        w.stxmltotable.tname, cols.c_str(), binds.c_str());
 
     // 如果入库参数中指定了表数据不需要更新，就不拼接update语句了，函数返回
-    if (stxmltotable.uptbz != 1) return;
+    if (w.stxmltotable.uptbz != 1) return;
 
     // 拼接更新表的SQL语句
     // sql语句固定根据主键查找记录，即where条件固定为主键
@@ -373,7 +765,7 @@ void crtsql()
     string strwhere = " where 1=1";     // where部分的字符串
     colseq = 1;                         // 绑定的序号
 
-    for (auto& e : tcols.m_vallcols)
+    for (auto& e : w.table->tcols.m_vallcols)
     {
         // 先处理set部分
         if (e.pkseq != 0) continue;
@@ -390,7 +782,7 @@ void crtsql()
         else if (strcmp(e.datatype,"date") == 0)
         {
             // date字段需要将值转成date类型
-            strset += sformat("%s=to_date(:%d,'yyyymmddhh24miss),", e.colname, colseq++);
+            strset += sformat("%s=to_date(:%d,'yyyymmddhh24miss'),", e.colname, colseq++);
         }
         else
         {
@@ -400,7 +792,7 @@ void crtsql()
     }
     deleterchr(strset, ','); // 删除最后一个逗号
 
-    for (auto& e : tcols.m_vpkcols)
+    for (auto& e : w.table->tcols.m_vpkcols)
     {
         // 区分date类型字段和非date类型字段
         if (strcmp(e.datatype,"date") == 0)
@@ -413,116 +805,315 @@ void crtsql()
         }
     }
 
-    updatesql = sformat("update %s%s%s", stxmltotable.tname, strset.c_str(), strwhere.c_str());
+    w.table->updatesql = sformat("update %s%s%s", w.stxmltotable.tname, strset.c_str(), strwhere.c_str());
 
     return;
 }
 
-void preparesql()
+bool crtstagetable(st_worker& w)
+{
+    // 临时表的名称为STG_表名（除去开头的两个字符"T_"），结构与目标表相同，提交事务时清空
+    // 临时表的数据只对本会话可见，多个进程和线程可以共用，不产生redo日志
+    // ORA-00955：名称已由现有对象使用，表示临时表已存在
+    // 注意：修改了目标表的结构之后，要删除临时表，让程序重新创建
+    if ((w.conn.execute("create global temporary table STG_%s on commit delete rows as select * from %s where 1=2",
+            w.stxmltotable.tname + 2, w.stxmltotable.tname) != 0) && (w.conn.rc() != 955))
+    {
+        logfile.write("[_xmltodb] create stage table STG_%s failed, loadmode append is ignored\n%s\n",
+            w.stxmltotable.tname + 2, w.conn.message());
+        return false;
+    }
+
+    return true;
+}
+
+void crtmergesql(st_worker& w)
+{
+    // 拼接merge语句，记录已存在时更新，不存在时插入，一批记录只需要执行一次
+    // merge into T_ZHOBTMIND1 t using (select :1 obtid,to_date(:2,'yyyymmddhh24miss') ddatetime,:3 t,... from dual) s              on (t.obtid=s.obtid and t.ddatetime=s.ddatetime)              when matched then update set t.t=s.t,...,t.upttime=sysdate              when not matched then insert(obtid,ddatetime,t,...,keyid) values(s.obtid,s.ddatetime,s.t,...,SEQ_ZHOBTMIND1.nextval)
+    // 绑定变量的顺序与插入语句相同，preparesql()按插入语句绑定
+    string strsel;      // using部分的字段
+    string stron;       // on部分的条件
+    string strset;      // update部分的字段
+    string cols;        // insert部分的字段列表
+    string vals;        // insert部分的值
+    int colseq = 1;     // 绑定的序号
+
+    for (auto& e : w.table->tcols.m_vallcols)
+    {
+        // upttime字段插入时用缺省值sysdate，更新时固定为sysdate
+        if (strcmp(e.colname,"upttime") == 0)
+        {
+            if (w.stxmltotable.uptbz == 1) strset += "t.upttime=sysdate,";
+            continue;
+        }
+
+        // keyid为递增字段，只在插入时取序列的值，不更新
+        if (strcmp(e.colname,"keyid") == 0)
+        {
+            cols += "keyid,";
+            vals += sformat("SEQ_%s.nextval,", w.stxmltotable.tname + 2);
+            continue;
+        }
+
+        if (strcmp(e.datatype,"date") == 0)
+            strsel += sformat("to_date(:%d,'yyyymmddhh24miss') %s,", colseq++, e.colname);
+        else
+            strsel += sformat(":%d %s,", colseq++, e.colname);
+
+        cols += sformat("%s,", e.colname);
+        vals += sformat("s.%s,", e.colname);
+
+        // 主键字段用于关联，不能更新
+        if (e.pkseq != 0)
+            stron += sformat("t.%s=s.%s and ", e.colname, e.colname);
+        else if (w.stxmltotable.uptbz == 1)
+            strset += sformat("t.%s=s.%s,", e.colname, e.colname);
+    }
+    deleterchr(strsel, ',');
+    deleterchr(cols, ',');
+    deleterchr(vals, ',');
+    deleterchr(strset, ',');
+    stron.resize(stron.length() - 5);   // 删除最后一个" and "
+
+    w.table->insertsql = sformat("merge into %s t using (select %s from dual) s on (%s)",
+        w.stxmltotable.tname, strsel.c_str(), stron.c_str());
+
+    // 不需要更新或者没有可以更新的字段时，已存在的记录保持不变
+    if (strset.empty() == false)
+        w.table->insertsql += sformat(" when matched then update set %s", strset.c_str());
+
+    w.table->insertsql += sformat(" when not matched then insert(%s) values(%s)", cols.c_str(), vals.c_str());
+}
+
+int execbatch(st_worker& w, const int rows)
+{
+    // 执行插入语句，个别记录失败不影响其它记录
+    if (w.table->stmtins.executearray(rows) != 0)
+    {
+        logfile.write("[_xmltodb: execute insert sql failed]\nsql: %s\nerror: %s\n", 
+            w.table->stmtins.sql(), w.table->stmtins.message());
+
+        // 如果是数据库系统出了问题，常见的问题如下，还可能有更多的错误，如果出现了，再加进来
+        // ORA-03113: 通信通道的文件结尾；ORA-03114: 未连接到ORACLE；ORA-03135: 连接失去联系；ORA-16014：归档失败
+        if ((w.table->stmtins.rc() == 3113) ||
+            (w.table->stmtins.rc() == 3114) ||
+            (w.table->stmtins.rc() == 3135) ||
+            (w.table->stmtins.rc() == 16014)) 
+            return 2;
+
+        // 表结构可能被修改了，缓存的字段和sql语句不能再用，整个文件都不能入库
+        if (ddlerror(w.table->stmtins.rc()) == true) { w.table->binvalid = true; return 8; }
+
+        return 0; // 整批记录都没有入库，但不是数据库系统的问题，不返回失败
+    }
+
+    w.inscount += w.table->stmtins.rpc(); // 插入的记录数，merge方式时是插入和更新的记录数，append方式时是插入临时表的记录数
+
+    // 逐条处理失败的记录
+    for (auto& e : w.table->stmtins.dmlerrors())
+    {
+        if (e.rc == 1) // 违反唯一性约束，表示记录已存在，执行更新语句
+        {
+            if ((w.stxmltotable.uptbz != 1) || (w.table->bmerge == true)) continue;
+
+            // 把失败记录的值复制到更新语句绑定的变量中
+            for (int i = 0; i < w.table->tcols.m_vallcols.size(); ++i)
+                w.table->vcolvalue[i] = &w.table->vcolarray[i][e.row * (w.table->tcols.m_vallcols[i].collen + 1)];
+
+            if (w.table->stmtupt.execute() != 0)
+            {
+                // 更新语句失败，主要是数据本身有问题，例如时间的格式不正确、数值不合法、数值太大
+                // 记录日志，但不返回失败
+                logfile.write("[_xmltodb: execute update sql failed]\nxml: %s\nsql: %s\nerror: %s\n", 
+                    recordtext(w, e.row).c_str(), w.table->stmtupt.sql(), w.table->stmtupt.message());
+
+                if (ddlerror(w.table->stmtupt.rc()) == true) { w.table->binvalid = true; return 8; }
+            }
+            else ++w.uptcount; // 更新的记录数加1
+        }
+        else
+        {
+            // 插入语句失败，是数据本身的问题，记录日志，不返回失败
+            logfile.write("[_xmltodb: execute insert sql failed]\nxml: %s\nsql: %s\nerror: %s\n", 
+                recordtext(w, e.row).c_str(), w.table->stmtins.sql(), e.message.c_str());
+        }
+    }
+
+    return 0;
+}
+
+bool ddlerror(const int rc)
 {
-    // 为输入变量的数组vcolvalue分配内存
-    vcolvalue.resize(tcols.m_vallcols.size());
+    // ORA-00942：表或视图不存在；ORA-00904：标识符无效；ORA-00913：值过多；ORA-00947：没有足够的值；
+    // ORA-00932：数据类型不一致；ORA-02289：序列不存在；ORA-04063：对象有错误
+    return (rc == 942) || (rc == 904) || (rc == 913) || (rc == 947) || (rc == 932) || (rc == 2289) || (rc == 4063);
+}
 
+void preparesql(st_worker& w)
+{
+    // 为输入变量vcolvalue和数组vcolarray分配内存
+    // vcolarray每个字段的数组存放batchsize条记录，每条记录占collen+1字节
+    w.table->vcolvalue.resize(w.table->tcols.m_vallcols.size());
+    w.table->vcolarray.resize(w.table->tcols.m_vallcols.size());
+    for (int i = 0; i < w.table->tcols.m_vallcols.size(); ++i)
+        w.table->vcolarray[i].assign(w.stxmltotable.batchsize * (w.table->tcols.m_vallcols[i].collen + 1), 0);
     // 准备插入的sql
-    stmtins.connect(&conn);
-    stmtins.prepare(insertsql);
+    w.table->stmtins.connect(&w.conn);
+    w.table->stmtins.prepare(w.table->insertsql);
 
     int colseq = 1;
-    for (int i = 0; i < tcols.m_vallcols.size(); ++i)
+    for (int i = 0; i < w.table->tcols.m_vallcols.size(); ++i)
     {   
         // upttime不需要处理
-        if (strcmp(tcols.m_vallcols[i].colname,"upttime") == 0) continue;
+        if (strcmp(w.table->tcols.m_vallcols[i].colname,"upttime") == 0) continue;
 
         // keyid字段不需要绑定
-        if (strcmp(tcols.m_vallcols[i].colname,"keyid") == 0) continue;
+        if (strcmp(w.table->tcols.m_vallcols[i].colname,"keyid") == 0) continue;
 
-        // 其它字段，值存放在容器vcolvalue中
-        // vcolvalue每个值的下标与m_vallcols一一对应
-        stmtins.bindin(colseq++, vcolvalue[i], tcols.m_vallcols[i].collen);
+        // 其它字段，值存放在数组vcolarray中
+        // vcolarray每个数组的下标与m_vallcols一一对应
+        w.table->stmtins.bindinarray(colseq++, &w.table->vcolarray[i][0], w.table->tcols.m_vallcols[i].collen);
     }
 
      // 如果入库参数中指定了表数据不需要更新，就不拼接update语句了，函数返回
-    if (stxmltotable.uptbz != 1) return;
+    // append方式还需要把临时表的记录插入目标表的sql语句，没有更新语句
+    if (w.table->bappend == true)
+    {
+        w.table->stmtapp.connect(&w.conn);
+        w.table->stmtapp.prepare(w.table->appendsql);
+        return;
+    }
+
+    if ((w.stxmltotable.uptbz != 1) || (w.table->bmerge == true)) return;
 
     // 准备更新的sql
-    stmtupt.connect(&conn);
-    stmtupt.prepare(updatesql);
+    w.table->stmtupt.connect(&w.conn);
+    w.table->stmtupt.prepare(w.table->updatesql);
 
     // 先绑定set部分
     colseq = 1;
-    for (int i = 0; i < tcols.m_vallcols.size(); ++i)
+    for (int i = 0; i < w.table->tcols.m_vallcols.size(); ++i)
     {   
-        if (tcols.m_vallcols[i].pkseq != 0) continue;
+        if (w.table->tcols.m_vallcols[i].pkseq != 0) continue;
 
         // keyid字段不需要处理
-        if (strcmp(tcols.m_vallcols[i].colname,"keyid") == 0) continue;
+        if (strcmp(w.table->tcols.m_vallcols[i].colname,"keyid") == 0) continue;
 
         // upttime不需要绑定
-        if (strcmp(tcols.m_vallcols[i].colname,"upttime") == 0) continue;
+        if (strcmp(w.table->tcols.m_vallcols[i].colname,"upttime") == 0) continue;
 
         // 其它字段，值存放在容器vcolvalue中
         // vcolvalue每个值的下标与m_vallcols一一对应
-        stmtupt.bindin(colseq++, vcolvalue[i], tcols.m_vallcols[i].collen);
+        w.table->stmtupt.bindin(colseq++, w.table->vcolvalue[i], w.table->tcols.m_vallcols[i].collen);
     }
 
     // 再绑定where部分
-    for (int i = 0; i < tcols.m_vallcols.size(); ++i)
+    for (int i = 0; i < w.table->tcols.m_vallcols.size(); ++i)
     {
-        if (tcols.m_vallcols[i].pkseq == 0) continue;
+        if (w.table->tcols.m_vallcols[i].pkseq == 0) continue;
 
-        stmtupt.bindin(colseq++, vcolvalue[i], tcols.m_vallcols[i].collen);
+        w.table->stmtupt.bindin(colseq++, w.table->vcolvalue[i], w.table->tcols.m_vallcols[i].collen);
     }
 
     return;
 }
 
-bool execsql()
+bool execsql(st_worker& w)
 {   
     // 没有sql要执行，返回true
-    if (strlen(stxmltotable.execsql) == 0) return true;
+    if (strlen(w.stxmltotable.execsql) == 0) return true;
 
-    stmtpre.connect(&conn);
-    stmtpre.prepare(stxmltotable.execsql);
-    if (stmtpre.execute() != 0) return false;
+    w.stmtpre.connect(&w.conn);
+    w.stmtpre.prepare(w.stxmltotable.execsql);
+    if (w.stmtpre.execute() != 0) return false;
     // 这里不提交，因为后续可能会回滚
 
     return true;
 }
 
-void splitbuffer(const string& xmlbuffer)
+void splitbuffer(st_worker& w, const char* xmlbuffer, const size_t len, const int row)
 {
-    string temp; // 存放字段值的临时变量
+    // 只扫描一次xml，得到全部字段的位置，字段的值直接从xml复制到绑定的数组中
+    w.record.parse(xmlbuffer, len);
 
-    for (int i = 0; i < tcols.m_vallcols.size(); ++i)
+    for (int i = 0; i < w.table->tcols.m_vallcols.size(); ++i)
     {
-        getxmlbuffer(xmlbuffer, tcols.m_vallcols[i].colname, 
-            temp, tcols.m_vallcols[i].collen);
+        auto& col = w.table->tcols.m_vallcols[i];
 
-        // 如果是日期时间字段date，提取数字就可以了
-        // 也就是说，xml文件中的日期时间只要包含了yyyymmddhh24miss就行，可以是任意分隔符
-        if (strcmp(tcols.m_vallcols[i].datatype, "date") == 0)
-        {
-            picknumber(temp, temp, false, false);
-        }
-        else if (strcmp(tcols.m_vallcols[i].datatype, "number") == 0)
-        {
-            // 如果是数值字段number，提取数字、+-符号和圆点
-            picknumber(temp, temp, true, true);
-        }
+        // sql对象绑定的是数组的地址，只能把值复制到数组中，不能改变数组的地址
+        char* value = &w.table->vcolarray[i][row * (col.collen + 1)];
+        memset(value, 0, col.collen + 1);
 
-        // 如果是字符字段char，不需要任何处理  
-        // 这里不能使用这行代码：vcolvalue[i]=temp;
-        // 因为sql对象绑定的是C风格的字符串，即char*
-        // 直接将temp赋值给vcolvalue[i]，会使用移动赋值
-        // 这将导致sql对象绑定的字符串指针指向temp
-        vcolvalue[i] = temp.c_str();    
+        const cxmlrecord::st_field* field = w.record.find(col.colname, strlen(col.colname));
+        if (field == nullptr) continue;
+
+        setvalue(col.datatype, col.collen, value, field->value, field->valuelen);
     }
 
     return;
 }
 
+void splitrecord(st_worker& w, const cbinreader& bfile, const int row)
+{
+    // 二进制格式的文件不需要解析，按预先找好的序号取字段的值
+    for (int i = 0; i < w.table->tcols.m_vallcols.size(); ++i)
+    {
+        auto& col = w.table->tcols.m_vallcols[i];
+
+        char* value = &w.table->vcolarray[i][row * (col.collen + 1)];
+        memset(value, 0, col.collen + 1);
+
+        if (w.vbinfield[i] < 0) continue;
+
+        setvalue(col.datatype, col.collen, value, bfile.value(w.vbinfield[i]), bfile.valuelen(w.vbinfield[i]));
+    }
+}
+
+void setvalue(const char* datatype, const int collen, char* value, const char* field, const size_t fieldlen)
+{
+    // 如果是字符字段char，不需要任何处理
+    if (strcmp(datatype, "char") == 0)
+    {
+        memcpy(value, field, min(fieldlen, (size_t)collen));
+        return;
+    }
+
+    // 如果是日期时间字段date，提取数字就可以了
+    // 也就是说，xml文件中的日期时间只要包含了yyyymmddhh24miss就行，可以是任意分隔符
+    // 如果是数值字段number，提取数字、+-符号和圆点
+    bool bnumber = (strcmp(datatype, "number") == 0);
+    int len = 0;
+    for (size_t j = 0; (j < fieldlen) && (len < collen); ++j)
+    {
+        char cc = field[j];
+        if ((isdigit(cc)) || ((bnumber == true) && ((cc == '+') || (cc == '-') || (cc == '.'))))
+            value[len++] = cc;
+    }
+}
+
+string recordtext(st_worker& w, const int row)
+{
+    // xml文件的记录在文件映射区中，原样输出
+    if (w.vxmlbuffer[row].first != nullptr) return string(w.vxmlbuffer[row].first, w.vxmlbuffer[row].second);
+
+    // 二进制格式的文件，记录所在的数据块可能已经被下一个数据块覆盖了，用绑定数组中的值拼成xml
+    string text;
+    for (int i = 0; i < w.table->tcols.m_vallcols.size(); ++i)
+    {
+        auto& col = w.table->tcols.m_vallcols[i];
+        text = text + "<" + col.colname + ">" + &w.table->vcolarray[i][row * (col.collen + 1)] + "</" + col.colname + ">";
+    }
+
+    return text + "<endl/>";
+}
+
 void EXIT(int sig)
 {
+    // 收到信号时只设置退出标志，由主线程通知入库线程退出并等待它们结束，再从main()正常返回，
+    // 入库线程还在运行时调用exit()，析构全局的线程对象会终止进程
+    if (sig > 0) { exitsig = sig; return; }
+
     logfile.write("[process exit] sig=%d\n", sig);
 
     exit(0);
@@ -538,7 +1129,13 @@ void _help()
     "<inifilename>/workspace/MDC/idc/ini/xmltodb.xml</inifilename>"
     "<xmlpath>/MDC/data/xmltodb/vip</xmlpath><xmlpathbak>/MDC/data/xmltodb/vipbak</xmlpathbak>"
     "<xmlpatherr>/MDC/data/xmltodb/viperr</xmlpatherr>"
-    "<timetvl>5</timetvl><timeout>63</timeout><pname>xmltodb_vip</pname>\"\n\n"
+    "<timetvl>5</timetvl><timeout>63</timeout><pname>xmltodb_vip</pname>\"\n"
+    "/MDC/bin/tools/procctl 10 /MDC/bin/tools/xmltodb /MDC/log/tools/xmltodb_vip.log "
+    "\"<connstr>idc/idcpwd@snorcl11g_132</connstr><charset>Simplified Chinese_China.AL32UTF8</charset>"
+    "<inifilename>/workspace/MDC/idc/ini/xmltodb.xml</inifilename>"
+    "<xmlpath>/MDC/data/xmltodb/vip</xmlpath><xmlpathbak>/MDC/data/xmltodb/vipbak</xmlpathbak>"
+    "<xmlpatherr>/MDC/data/xmltodb/viperr</xmlpatherr>"
+    "<timetvl>5</timetvl><timeout>63</timeout><pname>xmltodb_vip</pname><threads>4</threads>\"\n\n"
 
     "本程序是数据中心的公共功能模块，用于把xml文件入库到Oracle的表中\n"
     "logfilename   本程序运行的日志文件\n"
@@ -552,7 +1149,18 @@ void _help()
     "xmlpatherr  入库失败的xml文件存放的目录\n"
     "timetvl     扫描xmlpath目录的时间间隔（执行入库任务的时间间隔），单位：秒，视业务需求而定，2-30之间\n"
     "timeout     本程序的超时时间，单位：秒，视xml文件大小而定，建议设置30以上\n"
-    "pname       进程名，尽可能采用易懂的、与其它进程不同的名称，方便故障排查\n\n";
+    "pname       进程名，尽可能采用易懂的、与其它进程不同的名称，方便故障排查\n"
+    "threads     入库线程数，可选参数，缺省为1，取值在1-16之间，每个线程有自己的数据库连接，\n"
+    "            同一个表的文件总是由同一个线程按文件名的顺序入库，不同表的文件同时入库\n\n"
+    "inifilename中每个表的入库参数可以用<loadmode>merge</loadmode>指定用merge语句入库，一批记录只需要执行一次，\n"
+    "适用于更新很多的数据，merge方式的日志中insert是插入和更新的记录数之和，没有主键的表不能用merge方式\n"
+    "也可以用<loadmode>append</loadmode>指定先把记录插入临时表STG_表名（去掉T_），再用直接路径一次插入目标表，\n"
+    "适用于execsql先清空表再全量入库的数据，临时表由程序自动创建，修改了表结构之后要删除临时表\n"
+    "注意：直接路径插入只写在表的高水位线之上，不会重用delete释放的空间，execsql必须用truncate table清空表，\n"
+    "如果用delete from，每次全量入库表的存储空间都会增长，truncate会立即提交，文件入库失败时表是空的；\n"
+    "append方式不更新已存在的记录，只要有一条记录违反了唯一性约束，整个文件都不会入库，文件被移到xmlpatherr目录\n\n"
+    "xmlpath中后缀为.bin的文件是dminingoracle用<format>bin</format>或<format>binz</format>生成的二进制格式的文件，\n"
+    "入库的方法与xml文件相同，inifilename中filename的匹配规则要包括.bin文件，例如ZHOBTMIND_*.XML,ZHOBTMIND_*.BIN\n\n";
 }
 
 bool _xmltoarg(const string& xmlbuffer)
@@ -587,5 +1195,9 @@ bool _xmltoarg(const string& xmlbuffer)
     getxmlbuffer(xmlbuffer,"pname",starg.pname,63);
     if (strlen(starg.pname)==0) { logfile.write("pname is null.\n"); return false; }
 
+    getxmlbuffer(xmlbuffer,"threads",starg.threads);
+    if (starg.threads< 1) starg.threads=1;
+    if (starg.threads>16) starg.threads=16;
+
     return true;
 }
\ No newline at end of file